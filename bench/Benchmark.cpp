@@ -0,0 +1,448 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     Benchmark.cpp
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The performance regression suite. Each shape is tiled by a fixed schedule, compiled by the machine-code backend for
+// every instruction set that the CPU supports, checked against a reference product, and timed. Throughput is reported in
+// GFLOPS, and each result is keyed by the CPU model of the machine that measured it. Usage:
+//
+//     tiler_bench [--baseline baseline.json] [--output results.json] [--tolerance 0.15]
+//
+// With a baseline, the suite fails if the GFLOPS of a shape drop below (1 - tolerance) times the baseline of the same CPU
+// model, and exits with the skip status 77 if a shape has no baseline for this machine, since that shape wasn't gated. A
+// baseline records the median GFLOPS of repeated runs of the suite. A results file is a valid baseline, and the results of a
+// new machine are added to a baseline by appending them to its list
+
+#include "CompiledNest.h"
+#include "Kernel.h"
+#include "Nest.h"
+#include "ScheduleDatabase.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace tiler;
+
+// The exit status of a run that found no baseline for some of its shapes, which ctest reports as skipped
+const int skippedStatus = 77;
+
+// A batch of products C += A * B that share B, and the tile sizes of their schedule
+struct BenchmarkShape
+{
+    std::string name;
+    int m, n, k;
+    int batchSize;
+    int tileM, tileN, tileK;
+    MatrixOrder orderA;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    std::string machine;
+    std::string instructionSet;
+    double seconds;
+    double gflops;
+};
+
+// The schedules use the matrix-vector kernel, which takes up to 8 columns, as a register-blocked micro-kernel. The tiles of
+// the awkward shape don't divide any of its dimensions, so every loop is followed by a loop over smaller edge tiles
+const std::vector<BenchmarkShape> benchmarkShapes =
+{
+    {"square", 192, 192, 192, 1, 12, 8, 64, MatrixOrder::rowMajor},
+    {"tall_skinny", 3072, 8, 256, 1, 12, 8, 64, MatrixOrder::rowMajor},
+    {"batched_small", 16, 8, 16, 512, 8, 8, 16, MatrixOrder::rowMajor},
+    {"awkward", 100, 70, 50, 1, 12, 8, 16, MatrixOrder::columnMajor}
+};
+
+std::string GetInstructionSetName(InstructionSet instructionSet)
+{
+    return instructionSet == InstructionSet::avx2 ? "avx2" : "sse";
+}
+
+// The operands of a batch, with small integers that make every product exact
+struct BenchmarkData
+{
+    BenchmarkData(const BenchmarkShape& shape) :
+        layoutA(shape.m, shape.k, shape.orderA),
+        layoutB(shape.k, shape.n, MatrixOrder::rowMajor),
+        layoutC(shape.m, shape.n, MatrixOrder::rowMajor),
+        a(shape.batchSize, std::vector<float>(layoutA.Size())),
+        b(layoutB.Size()),
+        c(shape.batchSize, std::vector<float>(layoutC.Size()))
+    {
+        for(int batch = 0; batch < shape.batchSize; ++batch)
+        {
+            for(size_t index = 0; index < a[batch].size(); ++index)
+            {
+                a[batch][index] = static_cast<float>((index + batch) % 7) - 3;
+            }
+        }
+
+        for(size_t index = 0; index < b.size(); ++index)
+        {
+            b[index] = static_cast<float>(index % 5) - 2;
+        }
+    }
+
+    MatrixLayout layoutA, layoutB, layoutC;
+    std::vector<std::vector<float>> a;
+    std::vector<float> b;
+    std::vector<std::vector<float>> c;
+};
+
+// The loops that cover a dimension with tiles: whole tiles, then a single smaller tile for what remains
+struct TileRange
+{
+    int start, stop, size;
+};
+
+std::vector<TileRange> GetTileRanges(int size, int tileSize)
+{
+    std::vector<TileRange> ranges;
+    int wholeSize = size / tileSize * tileSize;
+    if(wholeSize > 0)
+    {
+        ranges.push_back({0, wholeSize, tileSize});
+    }
+    if(wholeSize < size)
+    {
+        ranges.push_back({wholeSize, size, size - wholeSize});
+    }
+    return ranges;
+}
+
+// Builds the nest of a shape: loops over rows, then K, then columns, and B is a constant operand whose tiles are packed
+// once. Each loop over edge tiles follows the loop over whole tiles of its dimension, with its own loops and kernel inside
+std::shared_ptr<Nest> MakeBenchmarkNest(const BenchmarkShape& shape, BenchmarkData& data)
+{
+    Variable A, B, C;
+    auto nest = MakeNest();
+    nest.Using(A, data.layoutA, false, data.a[0].data());
+    nest.Using(B, data.layoutB, false, data.b.data()).Constant();
+    nest.Using(C, data.layoutC, true, data.c[0].data());
+
+    std::vector<Variable> rowLoops;
+    for(const auto& rows : GetTileRanges(shape.m, shape.tileM))
+    {
+        Variable i;
+        auto rowLoop = nest.ForAll(i, rows.start, rows.stop, rows.size);
+        if(!rowLoops.empty())
+        {
+            rowLoop.Follows(rowLoops.back());
+        }
+        rowLoops.push_back(i);
+
+        std::vector<Variable> kLoops;
+        for(const auto& ks : GetTileRanges(shape.k, shape.tileK))
+        {
+            Variable k;
+            auto kLoop = nest.ForAll(k, ks.start, ks.stop, ks.size);
+            if(!kLoops.empty())
+            {
+                kLoop.Follows(kLoops.back());
+            }
+            kLoops.push_back(k);
+
+            std::vector<Variable> columnLoops;
+            for(const auto& columns : GetTileRanges(shape.n, shape.tileN))
+            {
+                Variable j, AA, BB, CC;
+                auto columnLoop = nest.ForAll(j, columns.start, columns.stop, columns.size);
+                if(!columnLoops.empty())
+                {
+                    columnLoop.Follows(columnLoops.back());
+                }
+                columnLoops.push_back(j);
+
+                nest.Tile(AA, A, i, k, rows.size, ks.size)
+                    .Tile(BB, B, k, j, ks.size, columns.size).Cache(MatrixOrder::rowMajor)
+                    .Tile(CC, C, i, j, rows.size, columns.size)
+                    .Kernel(AA, BB, CC, MVKernel);
+            }
+        }
+    }
+
+    return nest.GetNest();
+}
+
+// Runs a compiled nest on every product of the batch
+void RunBatch(CompiledNest& compiled, const Nest& nest, BenchmarkData& data)
+{
+    const auto& statements = nest.GetStatements();
+    auto variableA = statements[0]->GetVariable();
+    auto variableC = statements[2]->GetVariable();
+    for(size_t batch = 0; batch < data.a.size(); ++batch)
+    {
+        compiled.SetMatrix(variableA, data.a[batch].data());
+        compiled.SetMatrix(variableC, data.c[batch].data());
+        compiled.Run();
+    }
+}
+
+// Checks the outputs against a reference product in double precision
+void Verify(const std::string& label, const BenchmarkShape& shape, const BenchmarkData& data)
+{
+    for(int batch = 0; batch < shape.batchSize; ++batch)
+    {
+        for(int i = 0; i < shape.m; ++i)
+        {
+            for(int j = 0; j < shape.n; ++j)
+            {
+                double sum = 0;
+                for(int l = 0; l < shape.k; ++l)
+                {
+                    sum += static_cast<double>(data.a[batch][data.layoutA(i, l)]) * data.b[data.layoutB(l, j)];
+                }
+
+                double value = data.c[batch][data.layoutC(i, j)];
+                if(std::fabs(value - sum) > 1e-3 * (1 + std::fabs(sum)))
+                {
+                    std::ostringstream message;
+                    message << label << ": element (" << i << ", " << j << ") of product " << batch << " is " << value << " instead of " << sum;
+                    throw std::logic_error(message.str());
+                }
+            }
+        }
+    }
+}
+
+// Returns the fastest of a number of runs, after a warm-up run
+double TimeRuns(const std::function<void()>& run)
+{
+    using Clock = std::chrono::steady_clock;
+    const int minRuns = 3;
+    const double minSeconds = 0.05;
+
+    run();
+    double best = std::numeric_limits<double>::max();
+    double total = 0;
+    for(int runs = 0; runs < minRuns || total < minSeconds; ++runs)
+    {
+        auto start = Clock::now();
+        run();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        best = std::min(best, seconds);
+        total += seconds;
+    }
+    return best;
+}
+
+// A shape compiled for an instruction set, and checked, ready to be timed
+struct Benchmark
+{
+    Benchmark(const BenchmarkShape& shape, InstructionSet instructionSet) :
+        shape(shape), instructionSet(instructionSet), label(shape.name + "/" + GetInstructionSetName(instructionSet)), data(shape), nest(MakeBenchmarkNest(shape, data)), compiled(*nest, instructionSet)
+    {
+        RunBatch(compiled, *nest, data);
+        Verify(label, shape, data);
+    }
+
+    double TimeBatch()
+    {
+        return TimeRuns([&]() { RunBatch(compiled, *nest, data); });
+    }
+
+    BenchmarkResult GetResult(double seconds) const
+    {
+        double flops = 2.0 * shape.m * shape.n * shape.k * shape.batchSize;
+        return {label, GetCpuModel(), GetInstructionSetName(instructionSet), seconds, flops / seconds * 1e-9};
+    }
+
+    BenchmarkShape shape;
+    InstructionSet instructionSet;
+    std::string label;
+    BenchmarkData data;
+    std::shared_ptr<Nest> nest;
+    CompiledNest compiled;
+};
+
+// Escapes the quotes and backslashes of a string in a JSON file
+std::string EscapeJson(const std::string& text)
+{
+    std::string escaped;
+    for(char character : text)
+    {
+        if(character == '"' || character == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += character;
+    }
+    return escaped;
+}
+
+void WriteResults(const std::vector<BenchmarkResult>& results, std::ostream& stream)
+{
+    stream << "{\n    \"results\": [\n";
+    for(size_t index = 0; index < results.size(); ++index)
+    {
+        const auto& result = results[index];
+        stream << "        {\"name\": \"" << result.name << "\", \"machine\": \"" << EscapeJson(result.machine) << "\", \"instruction_set\": \"" << result.instructionSet
+            << "\", \"seconds\": " << result.seconds << ", \"gflops\": " << result.gflops << "}" << (index + 1 < results.size() ? ",\n" : "\n");
+    }
+    stream << "    ]\n}\n";
+}
+
+// Reads the GFLOPS of the results of a machine in a results file, by name
+std::map<std::string, double> ReadBaseline(const std::string& path, const std::string& machine)
+{
+    std::ifstream file(path);
+    if(!file)
+    {
+        throw std::logic_error("can't open baseline " + path);
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    auto text = buffer.str();
+
+    std::map<std::string, double> gflops;
+    std::regex entry("\\{[^{}]*\\}");
+    std::regex name("\"name\"\\s*:\\s*\"([^\"]*)\"");
+    std::regex machineName("\"machine\"\\s*:\\s*\"((?:[^\"\\\\]|\\\\.)*)\"");
+    std::regex value("\"gflops\"\\s*:\\s*([-+0-9.eE]+)");
+    for(std::sregex_iterator iter(text.begin(), text.end(), entry), end; iter != end; ++iter)
+    {
+        auto object = iter->str();
+        std::smatch nameMatch, machineMatch, valueMatch;
+        if(std::regex_search(object, nameMatch, name) && std::regex_search(object, machineMatch, machineName) && std::regex_search(object, valueMatch, value)
+            && machineMatch[1] == EscapeJson(machine))
+        {
+            gflops[nameMatch[1]] = std::stod(valueMatch[1]);
+        }
+    }
+    return gflops;
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        std::string baselinePath;
+        std::string outputPath = "tiler_bench.json";
+        double tolerance = 0.15;
+        for(int index = 1; index < argc; ++index)
+        {
+            std::string argument = argv[index];
+            if(index + 1 >= argc)
+            {
+                throw std::logic_error("missing value of " + argument);
+            }
+
+            if(argument == "--baseline")
+            {
+                baselinePath = argv[++index];
+            }
+            else if(argument == "--output")
+            {
+                outputPath = argv[++index];
+            }
+            else if(argument == "--tolerance")
+            {
+                tolerance = std::stod(argv[++index]);
+            }
+            else
+            {
+                throw std::logic_error("unknown argument " + argument);
+            }
+        }
+
+        std::vector<InstructionSet> instructionSets = { InstructionSet::sse };
+        if(GetSupportedInstructionSet() == InstructionSet::avx2)
+        {
+            instructionSets.push_back(InstructionSet::avx2);
+        }
+
+        std::vector<std::unique_ptr<Benchmark>> benchmarks;
+        for(auto instructionSet : instructionSets)
+        {
+            for(const auto& shape : benchmarkShapes)
+            {
+                benchmarks.emplace_back(new Benchmark(shape, instructionSet));
+            }
+        }
+
+        // each round times every benchmark, and a benchmark takes the median of its rounds, so that neither a slow nor a
+        // fast spell of a shared machine decides its result
+        const int numRounds = 7;
+        std::vector<std::vector<double>> rounds(benchmarks.size());
+        for(int round = 0; round < numRounds; ++round)
+        {
+            for(size_t index = 0; index < benchmarks.size(); ++index)
+            {
+                rounds[index].push_back(benchmarks[index]->TimeBatch());
+            }
+        }
+
+        std::vector<BenchmarkResult> results;
+        for(size_t index = 0; index < benchmarks.size(); ++index)
+        {
+            auto& times = rounds[index];
+            std::nth_element(times.begin(), times.begin() + numRounds / 2, times.end());
+            results.push_back(benchmarks[index]->GetResult(times[numRounds / 2]));
+            const auto& result = results.back();
+            std::cout << std::left << std::setw(24) << result.name << std::right << std::fixed << std::setprecision(3)
+                << std::setw(10) << result.seconds * 1e3 << " ms" << std::setw(10) << result.gflops << " GFLOPS" << std::endl;
+        }
+
+        std::ofstream output(outputPath);
+        WriteResults(results, output);
+        if(!output)
+        {
+            throw std::logic_error("can't write results to " + outputPath);
+        }
+
+        if(baselinePath.empty())
+        {
+            return 0;
+        }
+
+        // only slowdowns fail, and speedups beyond the tolerance are worth a new baseline
+        bool isSlower = false;
+        bool isUngated = false;
+        auto machine = GetCpuModel();
+        auto baseline = ReadBaseline(baselinePath, machine);
+        for(const auto& result : results)
+        {
+            auto iter = baseline.find(result.name);
+            if(iter == baseline.end())
+            {
+                std::cout << result.name << ": no baseline for " << machine << std::endl;
+                isUngated = true;
+            }
+            else if(result.gflops < iter->second * (1 - tolerance))
+            {
+                std::cout << result.name << ": SLOWER, " << result.gflops << " GFLOPS against a baseline of " << iter->second << std::endl;
+                isSlower = true;
+            }
+            else if(result.gflops > iter->second * (1 + tolerance))
+            {
+                std::cout << result.name << ": faster, " << result.gflops << " GFLOPS against a baseline of " << iter->second << std::endl;
+            }
+        }
+        return isSlower ? 1 : (isUngated ? skippedStatus : 0);
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
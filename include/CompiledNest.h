@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     CompiledNest.h
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "MatrixLayout.h"
+#include "Nest.h"
+#include "Variable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace tiler
+{
+    // The instruction sets of compiled nests: SSE scalar code, or AVX2 vectors with fused multiply-add
+    enum class InstructionSet { sse, avx2 };
+
+    // Returns the best instruction set that this CPU supports
+    InstructionSet GetSupportedInstructionSet();
+
+    // A nest lowered to x86-64 machine code in an executable buffer, which runs without a C++ compiler. The statements are
+    // ordered and nested as Nest::Print orders them. Inputs are read from the data of their Using statements and outputs
+    // are updated in place, while caches, scratch tiles, and matrices without data live in buffers owned by the compiled
+    // nest. Every kernel is lowered as C += A * B, the contract of the registered kernels. Throws for what the backend
+    // doesn't support: parallel loops that split outputs or share caches, combinations, mapped and block-sparse matrices,
+    // and blocked or morton layouts. Recursive kernels are lowered to machine-code functions that call each other, one per
+    // shape of the recursion. The body of a parallel loop is a function that a team of threads calls for their iterations.
+    //
+    // A compiled nest is a plan that runs many times. Cached tiles of constant matrices (see UsingStatementModifier::Constant)
+    // are packed once into an aligned arena, in the order of their loops, so a run only points each tile at its packed copy;
+    // other inputs and outputs can be rebound between runs with SetMatrix
+    class CompiledNest
+    {
+    public:
+        // Constructor
+        CompiledNest(Nest& nest, InstructionSet instructionSet = GetSupportedInstructionSet());
+        ~CompiledNest();
+
+        CompiledNest(const CompiledNest&) = delete;
+        CompiledNest& operator=(const CompiledNest&) = delete;
+
+        // Runs the nest
+        void Run();
+
+        // Binds an input or output that isn't constant to new data, which has the layout of its Using statement
+        void SetMatrix(const Variable& variable, float* data);
+
+        // Packs the constant matrices again, after their data has changed
+        void Invalidate();
+
+        // Returns the address of a matrix, which is its data or a buffer owned by the compiled nest
+        float* GetMatrix(const Variable& variable) const;
+
+        // Returns the size of the machine code in bytes, and its instruction set
+        size_t GetCodeSize() const { return _codeSize; }
+        InstructionSet GetInstructionSet() const { return _instructionSet; }
+
+    private:
+        // Padded Using statements copy their data into a buffer at the start of each run
+        struct PaddedCopy
+        {
+            std::string name;
+            const float* data;
+            MatrixLayout dataLayout;
+            float* buffer;
+            MatrixLayout layout;
+        };
+
+        // Cached tiles of constant matrices are packed at every position of their top and left loops, row after row
+        struct PackedTile
+        {
+            const float* data;
+            MatrixLayout dataLayout;
+            MatrixLayout tileLayout;
+            int topStart, numTops, topStep;
+            int leftStart, numLefts, leftStep;
+            int offset;
+            int slot;
+        };
+
+        struct BufferDeleter
+        {
+            void operator()(float* buffer) const;
+        };
+
+        // The body of a parallel loop runs one iteration with the slots of a thread, where the loop index and the buffers of
+        // the caches and scratch tiles in the loop are its own
+        struct ParallelLoop
+        {
+            size_t bodyPosition;
+            int slot;
+            int start, stop, step;
+            std::vector<int> privateSlots;
+            std::vector<std::vector<float*>> threadBuffers;
+        };
+
+        // Called by the compiled code with the slots at the parallel loop
+        static void RunParallelLoop(CompiledNest* compiledNest, const int64_t* slots);
+
+        int GetSlot(const std::string& name);
+        float* AllocateBuffer(int size);
+
+        InstructionSet _instructionSet;
+        std::map<std::string, int> _slotIndices;
+        std::vector<int64_t> _slots;
+        std::vector<std::unique_ptr<float, BufferDeleter>> _buffers;
+        std::vector<PaddedCopy> _paddedCopies;
+        std::vector<PaddedCopy> _constantCopies;
+        std::vector<PackedTile> _packedTiles;
+        std::set<std::string> _boundMatrices;
+        std::unique_ptr<ParallelLoop> _parallelLoop;
+        float* _arena = nullptr;
+        void* _code = nullptr;
+        size_t _codeSize = 0;
+    };
+}
@@ -10,9 +10,20 @@
 #include "Statement.h"
 
 #include <iostream>
+#include <string>
 
 namespace tiler
 {
     // 2x2x2 matrix multiplication kernel 
     void MMKernel222(std::ostream& stream, const MatrixStatement& matrixA, const MatrixStatement& matrixB, const MatrixStatement& matrixC);
+
+    // Matrix-vector kernel for any M and K and at most 8 columns of B (C += A * B, which covers tall-skinny products). It reads A
+    // exactly once: a row-major A by vectorized dot products along its rows, a column-major A by AXPY updates along its columns
+    void MVKernel(std::ostream& stream, const MatrixStatement& matrixA, const MatrixStatement& matrixB, const MatrixStatement& matrixC);
+
+    // Returns the name of a registered kernel
+    std::string GetKernelName(const KernelStatement::KernelType& kernel);
+
+    // Returns the registered kernel with a given name
+    KernelStatement::KernelType GetKernelByName(const std::string& name);
 }
\ No newline at end of file
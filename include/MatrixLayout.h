@@ -8,39 +8,129 @@
 #pragma once
 
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace tiler
 {
-    enum class MatrixOrder { rowMajor, columnMajor };
+    // blocked layouts store square blocks in row-major order, morton layouts store them in Z-order; each block is row-major
+    enum class MatrixOrder { rowMajor, columnMajor, blocked, morton };
 
-    // represents the layout of a matrix (size, order, etc)
+    // Converts between matrix orders and their short names
+    std::string GetOrderName(MatrixOrder order);
+    MatrixOrder GetOrderByName(const std::string& name);
+
+    // Interleaves the bits of a row and a column index into a Z-order index
+    constexpr int MortonIndex(int row, int column)
+    {
+        int index = 0;
+        for(int bit = 0; (row >> bit) != 0 || (column >> bit) != 0; ++bit)
+        {
+            index |= ((column >> bit) & 1) << (2 * bit);
+            index |= ((row >> bit) & 1) << (2 * bit + 1);
+        }
+        return index;
+    }
+
+    // represents the layout of a matrix (size, order, etc); layouts are literal types, so offsets of constant layouts can be
+    // computed at compile time
     class MatrixLayout
     {
     public:
         // Constructors
-        MatrixLayout(int numRows, int numColumns, MatrixOrder order, int leadingDimensionSize);
-        MatrixLayout(int numRows, int numColumns, MatrixOrder order);
+        constexpr MatrixLayout(int numRows, int numColumns, MatrixOrder order, int leadingDimensionSize, int blockSize) : _numRows(numRows), _numColumns(numColumns), _order(order), _leadingDimensionSize(leadingDimensionSize), _blockSize(blockSize)
+        {
+            if(_blockSize < 1 || (IsBlocked() && _leadingDimensionSize % _blockSize != 0))
+            {
+                throw std::logic_error("leading dimension of a blocked layout must be a multiple of its block size");
+            }
+        }
+
+        constexpr MatrixLayout(int numRows, int numColumns, MatrixOrder order, int leadingDimensionSize) : MatrixLayout(numRows, numColumns, order, leadingDimensionSize, 1)
+        {}
+
+        constexpr MatrixLayout(int numRows, int numColumns, MatrixOrder order) : MatrixLayout(numRows, numColumns, order, (order == MatrixOrder::columnMajor) ? numRows : numColumns, 1)
+        {}
 
         // Access layout parameters
-        int NumRows() const { return _numRows; }
-        int NumColumns() const { return _numColumns; }
-        MatrixOrder GetOrder() const { return _order; }
-        int GetLeadingDimensionSize() const { return _leadingDimensionSize; }
-        int Size() const;
-        int GetMajorSize() const;
-        int GetMinorSize() const;
+        constexpr int NumRows() const { return _numRows; }
+        constexpr int NumColumns() const { return _numColumns; }
+        constexpr MatrixOrder GetOrder() const { return _order; }
+        constexpr int GetLeadingDimensionSize() const { return _leadingDimensionSize; }
+        constexpr int GetBlockSize() const { return _blockSize; }
+        constexpr bool IsBlocked() const { return _order == MatrixOrder::blocked || _order == MatrixOrder::morton; }
+        constexpr int GetMajorSize() const { return (_order == MatrixOrder::columnMajor) ? _numColumns : _numRows; }
+        constexpr int GetMinorSize() const { return (_order == MatrixOrder::columnMajor) ? _numRows : _numColumns; }
+
+        // Returns the number of elements to allocate for the matrix, which includes the padding after its last row or column
+        constexpr int Size() const
+        {
+            if(_order == MatrixOrder::blocked)
+            {
+                int numBlockRows = (_numRows + _blockSize - 1) / _blockSize;
+                return numBlockRows * _blockSize * _leadingDimensionSize;
+            }
+
+            if(_order == MatrixOrder::morton)
+            {
+                int numBlockRows = (_numRows + _blockSize - 1) / _blockSize;
+                int numBlockColumns = (_numColumns + _blockSize - 1) / _blockSize;
+                return (MortonIndex(numBlockRows - 1, numBlockColumns - 1) + 1) * _blockSize * _blockSize;
+            }
+
+            return GetMajorSize() * _leadingDimensionSize;
+        }
+
+        // Returns the number of elements from the first element of the matrix to its last, which is the length of a user
+        // buffer that holds the matrix
+        constexpr int GetDataSize() const
+        {
+            return IsBlocked() ? Size() : (GetMajorSize() - 1) * _leadingDimensionSize + GetMinorSize();
+        }
 
         // Calculates the offset of a matrix element
-        int operator()(int row, int column) const;
+        constexpr int operator()(int row, int column) const
+        {
+            if(_order == MatrixOrder::rowMajor)
+            {
+                return row * _leadingDimensionSize + column;
+            }
+            else if(_order == MatrixOrder::columnMajor)
+            {
+                return row + column * _leadingDimensionSize;
+            }
+
+            int offsetInBlock = (row % _blockSize) * _blockSize + column % _blockSize;
+            if(_order == MatrixOrder::blocked)
+            {
+                return (row / _blockSize) * _leadingDimensionSize * _blockSize + (column / _blockSize) * _blockSize * _blockSize + offsetInBlock;
+            }
+            return MortonIndex(row / _blockSize, column / _blockSize) * _blockSize * _blockSize + offsetInBlock;
+        }
 
     private:
         int _numRows;
         int _numColumns;
         MatrixOrder _order; 
         int _leadingDimensionSize;
+        int _blockSize;
     };
 
     // Creates a vector of values from matrix-style initializer lists
     std::vector<float> MatrixToVector(MatrixOrder order, std::initializer_list<std::initializer_list<float>> list);
+    std::vector<float> MatrixToVector(MatrixOrder order, int blockSize, std::initializer_list<std::initializer_list<float>> list);
+
+    // Copies a matrix from one layout to another layout of the same size
+    void ConvertLayout(const float* source, const MatrixLayout& sourceLayout, float* target, const MatrixLayout& targetLayout);
+
+    // Determines if walking along the major dimension of a row-major or column-major layout (for example, down a column of a
+    // row-major matrix) crowds more rows into a cache set than half its ways, or steps by a multiple of 4KB (4K aliasing)
+    bool IsConflictProne(const MatrixLayout& layout);
+
+    // Returns the leading dimension size, padded to whole cache lines until a walk over numMajor rows is free of conflicts
+    int GetPaddedLeadingDimensionSize(int leadingDimensionSize, int numMajor);
+
+    // Returns a layout whose leading dimension is padded if the original layout is conflict-prone
+    MatrixLayout GetPaddedLayout(const MatrixLayout& layout);
 }
\ No newline at end of file
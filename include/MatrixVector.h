@@ -0,0 +1,21 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     MatrixVector.h
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "Nest.h"
+#include "Variable.h"
+
+namespace tiler
+{
+    // Appends the schedule of a matrix-vector or tall-skinny product C += A * B (B has at most 8 columns) to a nest that defines
+    // A, B, and C. A loop over panels of rows of A and C multiplies each panel by MVKernel, without packing, so A is streamed
+    // exactly once. The panels have panelSize rows, and the rows that remain after the last whole panel are a smaller panel
+    // of their own. A parallel panel loop gives each thread its own panels (and rows of C). It has the signature of a
+    // SubproductSchedule once panelSize and parallel are bound
+    void AppendMatrixVectorSchedule(NestStatementAppender nest, const Variable& matrixA, const Variable& matrixB, const Variable& matrixC, int panelSize = 256, bool parallel = false);
+}
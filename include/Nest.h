@@ -9,11 +9,14 @@
 
 #include "Variable.h"
 #include "MatrixLayout.h"
+#include "Profiler.h"
 #include "Statement.h"
 
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace tiler
@@ -24,6 +27,7 @@ namespace tiler
     public:
         using StatementPtr = std::shared_ptr<StatementBase>;
         using UsingStatementPtr = std::shared_ptr<UsingStatement>;
+        using StatementVisitor = std::function<void(const StatementPtr&)>;
 
         // Adds an element to the nest
         void AddStatement(StatementPtr nestStatement);
@@ -31,17 +35,45 @@ namespace tiler
         // Returns the numer of elements defined in the nest
         int Size() const;
 
+        // Returns the statements in the order they were added
+        const std::vector<StatementPtr>& GetStatements() const { return _statements; }
+
         // Finds a statement that matches a type and variable name
         template <typename StatementType = StatementBase>
         std::shared_ptr<StatementType> FindStatementByTypeAndVariable(const Variable& variable) const;
 
-        // Prints C++ code that implements the nest
-        void Print(std::ostream& stream);
+        // Prints C++ code that implements the nest, optionally instrumented with per-statement timers and hardware counters
+        void Print(std::ostream& stream, Instrumentation instrumentation = Instrumentation::none);
+
+        // Prints the helper functions used by a set of statements, which may come from several nests
+        static void PrintFunctions(std::ostream& stream, const std::vector<StatementPtr>& statements);
+
+        // Prints the statements of the nest, the body of the main function printed by Print
+        void PrintBody(std::ostream& stream, const StatementProfiler& profiler);
+
+        // Positions the tiles and kernels, and returns the statements in the order in which PrintBody prints them
+        std::vector<StatementPtr> GetOrderedStatements();
+
+        // Walks ordered statements the way PrintBody nests them, calling enter when a statement opens and exit when it closes
+        static void Traverse(const std::vector<StatementPtr>& orderedStatements, const StatementVisitor& enter, const StatementVisitor& exit);
 
     private:
+        // Streams memory-mapped matrices panel by panel
+        void SchedulePanelStreaming();
+
+        // Replaces the per-iteration address computations of tiles with pointers that are bumped by each loop
+        void ReduceAddressArithmetic(const std::vector<StatementPtr>& sortedStatements);
+
+        // Checks that a parallel loop writes disjoint outputs, and moves the allocations of the caches inside it into its body
+        void PrepareParallelLoop(std::vector<StatementPtr>& sortedStatements) const;
+
         std::vector<StatementPtr> _statements;
     };
 
+    class UsingStatementModifier;
+    class ForAllStatementModifier;
+    class RecursiveKernelStatementModifier;
+
     // Appends statements to a loop nest, serves as the base class for statement modifiers
     class NestStatementAppender
     {
@@ -50,24 +82,63 @@ namespace tiler
         NestStatementAppender(std::shared_ptr<Nest> nest);
 
         // Appends a Using statement
-        NestStatementAppender Using(Variable matrixVariable, MatrixLayout matrixLayout, bool isOutput, float* data);
+        UsingStatementModifier Using(Variable matrixVariable, MatrixLayout matrixLayout, bool isOutput, float* data);
+
+        // Appends a Using statement of an input matrix whose data is copied into an array with a padded leading dimension, if the original one causes cache conflicts
+        UsingStatementModifier UsingPadded(Variable matrixVariable, MatrixLayout matrixLayout, float* data);
+
+        // Appends a Using statement whose data is streamed from a memory-mapped file
+        NestStatementAppender UsingMapped(Variable matrixVariable, MatrixLayout matrixLayout, bool isOutput, std::string path);
+
+        // Appends a Using statement of a block-sparse input matrix, which stores only its nonzero blocks (see BlockSparseUsingStatement)
+        NestStatementAppender UsingBlockSparse(Variable matrixVariable, MatrixLayout matrixLayout, int blockRows, int blockColumns, float* data);
 
         // Appends a ForAll statement
         inline auto ForAll(Variable indexVariable, int start, int stop, int step);
 
+        // Appends a ForAll statement over the nonzero blocks of a block-sparse matrix in the block row at the value of a row
+        // index, which must enclose it. The index is the left column of each block; tiles of the matrix are its blocks, at the
+        // row index and this index, and tiles of other matrices at this index are taken only where A has nonzero blocks
+        ForAllStatementModifier ForAllBlocks(Variable indexVariable, Variable matrixVariable, Variable rowVariable);
+
         // Appends a Tile statement
         inline auto Tile(Variable tileVariable, Variable matrixVariable, Variable topVariable, Variable leftVariable, int numRows, int numColumns);
 
+        // Appends a Scratch statement, a temporary tile that is zeroed at the position of its dependencies and can pass the output of one kernel to the next
+        NestStatementAppender Scratch(Variable scratchVariable, Variable topVariable, Variable leftVariable, int numRows, int numColumns, MatrixOrder order);
+
         // Appends a Kernel statement
         NestStatementAppender Kernel(const Variable& matrixAVariable, const Variable& matrixBVariable, const Variable& matrixCVariable, KernelStatement::KernelType kernel);
 
+        // Appends a cache-oblivious recursive Kernel statement, which halves the largest of M, N, K until it reaches the kernel size baseM x baseN x baseK
+        RecursiveKernelStatementModifier RecursiveKernel(const Variable& matrixAVariable, const Variable& matrixBVariable, const Variable& matrixCVariable, KernelStatement::KernelType kernel, int baseM, int baseN, int baseK);
+
         // Prints the underlying nest
-        void Print(std::ostream& stream) const;
+        void Print(std::ostream& stream, Instrumentation instrumentation = Instrumentation::none) const;
+
+        // Returns the underlying nest
+        std::shared_ptr<Nest> GetNest() const { return _nest; }
 
     protected:
         std::shared_ptr<Nest> _nest;
     };
 
+    // Modifies Using statements, and appends new statements to a loop nest
+    class UsingStatementModifier : public NestStatementAppender
+    {
+    public:
+        // Constructor
+        UsingStatementModifier(std::shared_ptr<Nest> nest, std::shared_ptr<UsingStatement> matrix);
+
+        // Marks the data of an input matrix as constant across runs. A compiled nest packs the cached tiles of the matrix
+        // once, when it is built, instead of copying them on every run (see CompiledNest::Invalidate), so it requires the
+        // data; a nest that is only printed or serialized can be marked constant without it
+        UsingStatementModifier Constant();
+
+    private:
+        std::shared_ptr<UsingStatement> _matrix;
+    };
+
     // Modifies ForAll statements, and appends new statements to a loop nest
     class ForAllStatementModifier : public NestStatementAppender
     {
@@ -78,6 +149,17 @@ namespace tiler
         // Modifies the position of the underlying ForAll loop
         ForAllStatementModifier Position(double Position);
 
+        // Makes the underlying ForAll loop a sibling that opens after another loop (and everything nested in it) is closed
+        ForAllStatementModifier Follows(Variable loopVariable);
+
+        // Runs the iterations of the underlying ForAll loop in parallel, on threads pinned to the cores of each NUMA node. The caches
+        // and scratch tiles inside the loop are private to each thread. An output that the loop doesn't index (as in a parallel K
+        // loop) is split: each thread accumulates into its own zeroed copy, and the copies are summed after the loop
+        ForAllStatementModifier Parallel();
+
+        // Gives each NUMA node its own copy of an input matrix that is read by the underlying parallel loop
+        ForAllStatementModifier Replicate(Variable matrixVariable);
+
     private:
         static double _loopCounter;
         std::shared_ptr<ForAllStatement> _loop;
@@ -93,10 +175,28 @@ namespace tiler
         // Tells the Tile statement to cache the tile 
         NestStatementAppender Cache(MatrixOrder order);
 
+        // Tells the Tile statement to cache an input tile in one buffer for all the threads of the enclosing parallel loop. The
+        // tile must not depend on the loop; the threads pack a slice each, with a barrier before and after, and the loop runs in lockstep
+        NestStatementAppender CacheShared(MatrixOrder order);
+
     private:
         std::shared_ptr<TileStatement> _tile;
     };
 
+    // Modifies recursive Kernel statements, and appends new statements to a loop nest
+    class RecursiveKernelStatementModifier : public NestStatementAppender
+    {
+    public:
+        // Constructor
+        RecursiveKernelStatementModifier(std::shared_ptr<Nest> nest, std::shared_ptr<RecursiveKernelStatement> kernel);
+
+        // Tells the recursion to cache an operand at a given recursion depth (the top call has depth 0)
+        RecursiveKernelStatementModifier CacheAt(Variable matrixVariable, int depth, MatrixOrder order);
+
+    private:
+        std::shared_ptr<RecursiveKernelStatement> _kernel;
+    };
+
     //
     //
     //
@@ -134,16 +234,74 @@ namespace tiler
     {
         auto matrixStatement = _nest->FindStatementByTypeAndVariable<MatrixStatement>(matrixVariable);
         auto matrixLayout = matrixStatement->GetLayout();
-        
-        if(matrixLayout.NumRows() % numRows != 0 || matrixLayout.NumColumns() % numColumns)
+        auto topStatement = _nest->FindStatementByTypeAndVariable(topVariable);
+        auto leftStatement = _nest->FindStatementByTypeAndVariable(leftVariable);
+
+        // a tile at the values of a loop stays inside the matrix, and a tile at any other index divides it
+        auto fits = [](const Nest::StatementPtr& indexStatement, int matrixSize, int tileSize)
+        {
+            auto loop = std::dynamic_pointer_cast<ForAllStatement>(indexStatement);
+            if(loop == nullptr || std::dynamic_pointer_cast<BlockForAllStatement>(loop) != nullptr)
+            {
+                return matrixSize % tileSize == 0;
+            }
+
+            int last = loop->GetStart() + (loop->GetStop() - loop->GetStart() - 1) / loop->GetStep() * loop->GetStep();
+            return loop->GetStart() >= loop->GetStop() || (loop->GetStart() >= 0 && last + tileSize <= matrixSize);
+        };
+
+        if(!fits(topStatement, matrixLayout.NumRows(), numRows) || !fits(leftStatement, matrixLayout.NumColumns(), numColumns))
         {
             throw std::logic_error("size of tile " + tileVariable.GetName() + " is incompatible with matrix " + matrixStatement->GetVariable().GetName());
         }
 
-        MatrixLayout tileLayout(numRows, numColumns, matrixLayout.GetOrder(), matrixLayout.GetLeadingDimensionSize());
+        // a tile of a blocked matrix either lies within a block or covers whole blocks (a power of two of them, in morton order)
+        if(matrixLayout.IsBlocked())
+        {
+            int blockSize = matrixLayout.GetBlockSize();
+            bool isWithinBlock = (blockSize % numRows == 0 && blockSize % numColumns == 0);
+            bool isWholeBlocks = (numRows % blockSize == 0 && numColumns % blockSize == 0);
+            if(isWholeBlocks && matrixLayout.GetOrder() == MatrixOrder::morton)
+            {
+                int numBlockRows = numRows / blockSize;
+                int numBlockColumns = numColumns / blockSize;
+                isWholeBlocks = (numBlockRows & (numBlockRows - 1)) == 0 && (numBlockColumns & (numBlockColumns - 1)) == 0;
+            }
 
-        auto topStatement = _nest->FindStatementByTypeAndVariable(topVariable);
-        auto leftStatement = _nest->FindStatementByTypeAndVariable(leftVariable);
+            if(!isWithinBlock && !isWholeBlocks)
+            {
+                throw std::logic_error("size of tile " + tileVariable.GetName() + " is incompatible with the blocks of matrix " + matrixStatement->GetVariable().GetName());
+            }
+
+            // the tile offset assumes that every tile starts at a multiple of its size (of the block size, for whole blocks in
+            // blocked order), so that it neither straddles blocks nor starts inside a group of morton blocks
+            bool isMortonBlocks = isWholeBlocks && matrixLayout.GetOrder() == MatrixOrder::morton;
+            auto isAligned = [](const Nest::StatementPtr& indexStatement, int alignment)
+            {
+                auto loop = std::dynamic_pointer_cast<ForAllStatement>(indexStatement);
+                return loop != nullptr && std::dynamic_pointer_cast<BlockForAllStatement>(loop) == nullptr && loop->GetStart() % alignment == 0 && loop->GetStep() % alignment == 0;
+            };
+
+            if(!isAligned(topStatement, (isWithinBlock || isMortonBlocks) ? numRows : blockSize) || !isAligned(leftStatement, (isWithinBlock || isMortonBlocks) ? numColumns : blockSize))
+            {
+                throw std::logic_error("tile " + tileVariable.GetName() + " of blocked matrix " + matrixStatement->GetVariable().GetName() + " must be at loops that start and step at multiples of its size");
+            }
+        }
+
+        MatrixLayout tileLayout(numRows, numColumns, matrixLayout.GetOrder(), matrixLayout.GetLeadingDimensionSize(), matrixLayout.GetBlockSize());
+
+        // a tile of a block-sparse matrix is one of its packed blocks, at the row index of a BlockForAll loop over the matrix and the loop itself
+        auto sparseStatement = std::dynamic_pointer_cast<BlockSparseUsingStatement>(matrixStatement);
+        if(sparseStatement != nullptr)
+        {
+            auto blockLoop = std::dynamic_pointer_cast<BlockForAllStatement>(leftStatement);
+            auto blockLayout = sparseStatement->GetBlockLayout();
+            if(blockLoop == nullptr || blockLoop->GetMatrixStatement() != sparseStatement || blockLoop->GetRowStatement() != topStatement || numRows != blockLayout.NumRows() || numColumns != blockLayout.NumColumns())
+            {
+                throw std::logic_error("tile " + tileVariable.GetName() + " of block-sparse matrix " + matrixStatement->GetVariable().GetName() + " must be a block at a BlockForAll loop");
+            }
+            tileLayout = blockLayout;
+        }
 
         auto tile = std::make_shared<TileStatement>(tileVariable, tileLayout, matrixStatement, topStatement, leftStatement);
         _nest->AddStatement(tile);
@@ -26,6 +26,9 @@ namespace tiler
     template <typename ArgType, typename... ArgTypes>
     void PrintFormated(std::ostream& os, const char* format, const ArgType& arg, const ArgTypes&... args);
 
+    // Formatted printing without arguments, which ends the recursion of the template above
+    void PrintFormated(std::ostream& os, const char* format);
+
     // Substitution symbol for PrintFormat calls
     const char substitutionSymbol = '%';
 
@@ -55,7 +58,4 @@ namespace tiler
 
         PrintFormated(os, format, args...);
     }
-
-    // internal
-    void PrintFormated(std::ostream& os, const char* format);
 }
@@ -0,0 +1,57 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     Profiler.h
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "Statement.h"
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tiler
+{
+    // Instrumentation modes of a printed nest: none, timers, or timers and hardware counters (cycles, L1 misses, LLC misses, dTLB misses)
+    enum class Instrumentation { none, timers, counters };
+
+    // Prints the timers that wrap loops, cache copies, and kernels of an instrumented nest. Kernels and copies are sampled:
+    // every call is counted, but only one call in 64 is timed, and the report scales the sampled totals to all the calls
+    class StatementProfiler
+    {
+    public:
+        // Abbreviations
+        using StatementPtr = std::shared_ptr<StatementBase>;
+
+        // Constructor, assigns a profile entry to each timed statement
+        StatementProfiler(Instrumentation instrumentation, const std::vector<StatementPtr>& statements);
+
+        // Prints the profiling functions and the table of profile entries
+        void PrintFunctions(std::ostream& stream) const;
+
+        // Prints the start of the timer that covers the entire nest
+        void PrintStart(std::ostream& stream) const;
+
+        // Prints a statement wrapped in timers
+        void PrintForward(std::ostream& stream, const StatementPtr& statement) const;
+        void PrintBackward(std::ostream& stream, const StatementPtr& statement) const;
+
+        // Prints the end of the timer that covers the entire nest and the per-statement report
+        void PrintReport(std::ostream& stream) const;
+
+    private:
+        int AddEntry(const std::string& name);
+        void PrintTimerStart(std::ostream& stream, int entry, bool isSampled) const;
+        void PrintTimerStop(std::ostream& stream, int entry, bool isSampled) const;
+
+        Instrumentation _instrumentation;
+        std::vector<std::string> _names;
+        std::map<const StatementBase*, int> _forwardEntries;
+        std::map<const StatementBase*, int> _backwardEntries;
+    };
+}
@@ -0,0 +1,31 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     Schedule.h
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "MatrixLayout.h"
+#include "Nest.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace tiler
+{
+    // Writes a schedule, a textual description of a nest with one statement per line. Variables are renamed
+    // x0, x1, ... in order of appearance, so that a deserialized nest serializes to the same text. Kernels
+    // must be registered (see GetKernelName), and the data of Using statements is not part of the schedule.
+    // Parallel loops, their replicated matrices, and shared caches are flags at the end of their lines.
+    void SerializeNest(const Nest& nest, std::ostream& stream);
+
+    // Reads a schedule, binding the data of the Using statements in order (missing data is nullptr)
+    std::shared_ptr<Nest> DeserializeNest(std::istream& stream, const std::vector<float*>& data = {});
+
+    // Reads a schedule, replacing the layouts of the Using statements in order. Loops that span a dimension
+    // of a replaced matrix are retargeted to the new dimension; throws if a tile does not fit the new layout
+    std::shared_ptr<Nest> DeserializeNest(std::istream& stream, const std::vector<MatrixLayout>& layouts, const std::vector<float*>& data);
+}
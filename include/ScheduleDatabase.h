@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     ScheduleDatabase.h
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "MatrixLayout.h"
+#include "Nest.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tiler
+{
+    // Identifies a tuned GEMM problem (A is MxK, B is KxN, C is MxN)
+    struct ScheduleKey
+    {
+        int m;
+        int n;
+        int k;
+        MatrixOrder orderA;
+        MatrixOrder orderB;
+        MatrixOrder orderC;
+        std::string dataType;
+        std::string cpuModel;
+    };
+
+    // Returns the CPU model of this machine, as reported by /proc/cpuinfo
+    std::string GetCpuModel();
+
+    // Stores the schedules of tuned GEMM nests, keyed by shape, layouts, data type, and CPU model
+    class ScheduleDatabase
+    {
+    public:
+        // Adds a schedule, replacing a schedule with the same key. The Using statements of the nest are A, B, C, in that order
+        void Add(const ScheduleKey& key, const Nest& nest);
+        void Add(const ScheduleKey& key, const std::string& schedule);
+
+        // Returns the number of schedules
+        int Size() const { return static_cast<int>(_entries.size()); }
+
+        // Returns the schedules that match the layouts and data type of a key, the exact shape first and then
+        // by distance between log-shapes. Schedules tuned on a different CPU model come after those of the same model
+        std::vector<std::string> FindNearest(const ScheduleKey& key) const;
+
+        // Reads and writes the database
+        void Load(std::istream& stream);
+        void Save(std::ostream& stream) const;
+
+    private:
+        struct Entry
+        {
+            ScheduleKey key;
+            std::string schedule;
+        };
+
+        std::vector<Entry> _entries;
+    };
+
+    // Picks the schedule for a GEMM on this machine and instantiates it for the given layouts and data. Falls back
+    // to the nearest tuned shape whose tiles fit the problem, and throws if there is none
+    std::shared_ptr<Nest> DispatchSchedule(const ScheduleDatabase& database, MatrixLayout layoutA, MatrixLayout layoutB, MatrixLayout layoutC, float* dataA, float* dataB, float* dataC);
+}
@@ -13,6 +13,8 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace tiler
 {
@@ -59,10 +61,101 @@ namespace tiler
         int GetStop() const { return _stop; }
         int GetStep() const { return _step; }
 
+        // Tells the loop to prefetch the next panel of a memory-mapped matrix at the top of each iteration
+        void AddPanelPrefetch(const std::string& matrixName, int matrixSize, int panelStride);
+
+        // Adds a pointer that is initialized before the loop and advanced by a fixed stride at the end of each iteration
+        void AddInductionPointer(const std::string& name, const std::string& initialValue, int stride);
+
+        // Get and set the sibling loop that must be closed before this loop is opened
+        const std::shared_ptr<ForAllStatement>& GetPredecessor() const { return _predecessor; }
+        void SetPredecessor(std::shared_ptr<ForAllStatement> predecessor) { _predecessor = predecessor; }
+
+        // Get and set the explicit position flag, the scheduler keeps a loop positioned by the user where the user put it
+        bool IsPositioned() const { return _positioned; }
+        void SetPositioned(bool positioned = true) { _positioned = positioned; }
+
+        // Get and set the parallel flag, a parallel loop runs its iterations on threads pinned to the cores of each NUMA node
+        bool IsParallel() const { return _parallel; }
+        void SetParallel(bool parallel = true) { _parallel = parallel; }
+
+        // Get and set the lockstep flag, the threads of a lockstep loop run the same number of iterations so that they meet at the same barriers
+        bool IsLockstep() const { return _lockstep; }
+        void SetLockstep(bool lockstep = true) { _lockstep = lockstep; }
+
+        // Tells a parallel loop to copy a matrix to each NUMA node, and to use the copy of its own node in each iteration
+        void AddReplica(const std::string& matrixName, int matrixSize);
+
+        // Returns the names of the replicated matrices
+        std::vector<std::string> GetReplicaNames() const;
+
+        // Tells a parallel loop to split an output that its iterations don't index: each thread accumulates into its own zeroed
+        // copy of the output, and the copies are summed into the output after the loop
+        void AddPartial(const std::string& matrixName, int matrixSize);
+
+        // Returns the names of the split outputs
+        std::vector<std::string> GetPartialNames() const;
+
+        // Determines if the body of the loop replaces a matrix by a replica or a partial copy of the same name
+        bool Shadows(const std::string& matrixName) const;
+
     private:
+        struct PanelPrefetch
+        {
+            std::string matrixName;
+            int matrixSize;
+            int panelStride;
+        };
+
+        struct InductionPointer
+        {
+            std::string name;
+            std::string initialValue;
+            int stride;
+        };
+
+        struct MatrixCopy
+        {
+            std::string matrixName;
+            int matrixSize;
+        };
+
         int _start;
         int _stop;
         int _step;
+        bool _positioned = false;
+        bool _parallel = false;
+        bool _lockstep = false;
+        std::vector<MatrixCopy> _replicas;
+        std::vector<MatrixCopy> _partials;
+        std::vector<PanelPrefetch> _panelPrefetches;
+        std::vector<InductionPointer> _inductionPointers;
+        std::shared_ptr<ForAllStatement> _predecessor;
+    };
+
+    class BlockSparseUsingStatement;
+
+    // ForAll statements over the nonzero blocks of a block-sparse matrix in the block row at the value of another loop index. The
+    // index takes the left column of each block, and the block counter (the index name with a _block suffix) its position in the packed blocks
+    class BlockForAllStatement : public ForAllStatement
+    {
+    public:
+        // Constructor
+        BlockForAllStatement(const Variable& indexVariable, std::shared_ptr<BlockSparseUsingStatement> matrixStatement, std::shared_ptr<ForAllStatement> rowStatement);
+
+        // Prints the statement
+        void PrintForward(std::ostream& stream) const override;
+
+        // Access the block-sparse matrix and the loop over its block rows
+        const std::shared_ptr<BlockSparseUsingStatement>& GetMatrixStatement() const { return _matrixStatement; }
+        const std::shared_ptr<ForAllStatement>& GetRowStatement() const { return _rowStatement; }
+
+        // Returns the name of the block counter
+        std::string GetBlockName() const { return GetVariable().GetName() + "_block"; }
+
+    private:
+        std::shared_ptr<BlockSparseUsingStatement> _matrixStatement;
+        std::shared_ptr<ForAllStatement> _rowStatement;
     };
 
     // Base class for Matrix statement (Using, Tile)
@@ -95,8 +188,124 @@ namespace tiler
         // Prints the statement
         void PrintForward(std::ostream& stream) const override;
 
+        // Returns the data that initializes the matrix
+        float* GetData() const { return _data; }
+
+        // Marks the data as unchanged from one run to the next, such as weights, so compiled nests pack its cached tiles once
+        bool IsConstant() const { return _isConstant; }
+        void SetConstant(bool constant = true) { _isConstant = constant; }
+
     private:
         float* _data;
+        bool _isConstant = false;
+    };
+
+    // Using statements that copy their data into an array whose leading dimension is padded to avoid cache conflicts
+    class PaddedUsingStatement : public UsingStatement
+    {
+    public:
+        // Constructor, the data has the given layout
+        PaddedUsingStatement(const Variable& matrixVariable, MatrixLayout matrixLayout, float* data);
+
+        // Prints the statement
+        void PrintForward(std::ostream& stream) const override;
+
+        // Returns the layout of the data before padding
+        const MatrixLayout& GetDataLayout() const { return _dataLayout; }
+
+    private:
+        MatrixLayout _dataLayout;
+    };
+
+    // Using statements whose data is a memory-mapped file (read-only for inputs, writable for outputs)
+    class MappedUsingStatement : public UsingStatement
+    {
+    public:
+        // Constructor
+        MappedUsingStatement(const Variable& matrixVariable, MatrixLayout matrixLayout, bool isOutput, std::string path);
+
+        // Prints the statement
+        void PrintForward(std::ostream& stream) const override;
+        void PrintBackward(std::ostream& stream) const override;
+
+        // Returns the path of the mapped file
+        const std::string& GetPath() const { return _path; }
+
+    private:
+        std::string _path;
+    };
+
+    // Using statements of block-sparse input matrices, stored in BSR format: the nonzero blocks of each block row are packed
+    // contiguously, each in the order of the matrix, along with the left column of each block. A tile of the matrix is one of
+    // its blocks, in a BlockForAll loop over the nonzero blocks of a block row
+    class BlockSparseUsingStatement : public UsingStatement
+    {
+    public:
+        // Constructor, the data is dense in the given layout, and a block is nonzero if any of its elements is
+        BlockSparseUsingStatement(const Variable& matrixVariable, MatrixLayout matrixLayout, int blockRows, int blockColumns, float* data);
+
+        // Prints the statement
+        void PrintForward(std::ostream& stream) const override;
+
+        // Returns the layout of a block, and the number of floats in the packed blocks
+        MatrixLayout GetBlockLayout() const;
+        int GetStorageSize() const { return static_cast<int>(_blocks.size()); }
+
+        // Returns the number of nonzero blocks, and the names of the arrays of the first nonzero block of each block row and the left column of each nonzero block
+        int NumNonzeroBlocks() const { return static_cast<int>(_blockLefts.size()); }
+        std::string GetRowStartsName() const { return GetVariable().GetName() + "_rowStarts"; }
+        std::string GetBlockColumnsName() const { return GetVariable().GetName() + "_blockColumns"; }
+
+    private:
+        int _blockRows;
+        int _blockColumns;
+        std::vector<int> _rowStarts;
+        std::vector<int> _blockLefts;
+        std::vector<float> _blocks;
+    };
+
+    // Using statements that view a sum of scaled submatrices of a parent matrix, each with the parent's leading dimension.
+    // Cached tiles of a combination sum the terms as they are packed, and output tiles add themselves to every term as they
+    // are unpacked. Alternatively, the combination is materialized in a workspace, which is added back to the parent if it is an output
+    class CombinationUsingStatement : public UsingStatement
+    {
+    public:
+        // A submatrix, given by the offset of its first element in the parent, and its coefficient
+        struct Term
+        {
+            int offset;
+            float coefficient;
+        };
+
+        // Constructor
+        CombinationUsingStatement(const Variable& matrixVariable, MatrixLayout matrixLayout, bool isOutput, const Variable& parentVariable, std::vector<Term> terms);
+
+        // Prints the statement
+        void PrintForward(std::ostream& stream) const override;
+        void PrintBackward(std::ostream& stream) const override;
+
+        // Determines if the combination is a single submatrix with coefficient 1
+        bool IsView() const;
+
+        // Materializes the combination in a workspace with a tight layout, must be called before tiles of the combination are added
+        void Materialize(const std::string& workspaceName);
+        bool IsMaterialized() const { return !_workspaceName.empty(); }
+
+        // Determines if tiles of the combination sum its terms when they are packed
+        bool IsFused() const { return !IsView() && !IsMaterialized(); }
+
+        // Returns the number of terms and the names of the arrays of term offsets (relative to the first term) and coefficients
+        int NumTerms() const { return static_cast<int>(_terms.size()); }
+        std::string GetOffsetsName() const { return GetVariable().GetName() + "_offsets"; }
+        std::string GetCoefficientsName() const { return GetVariable().GetName() + "_coefficients"; }
+
+    private:
+        std::string GetFirstTermExpression() const;
+
+        Variable _parentVariable;
+        std::vector<Term> _terms;
+        int _parentLeadingDimensionSize;
+        std::string _workspaceName;
     };
 
     // Tile statements
@@ -121,14 +330,64 @@ namespace tiler
         void SetCache(bool cache = true) { _cache = cache; }
         bool IsCached() const { return _cache; }
 
+        // Set the shared flag, a shared cache is a single buffer that the threads of a parallel loop pack together
+        void SetShared(bool shared = true) { _shared = shared; }
+        bool IsShared() const { return _shared; }
+
         // Determines if the tile is transposed with repsect to the original data
         bool IsTransposed() const { return _matrixStatement->GetLayout().GetOrder() != GetLayout().GetOrder(); }
 
+        // Determines if the cache copy goes through offset tables, which is the case for blocked and morton layouts
+        bool RequiresIndexedCopy() const;
+
+        // Prints the offset tables used by an indexed cache copy
+        void PrintOffsetTables(std::ostream& stream) const;
+
+        // Tells the tile to take its address from an induction pointer instead of computing it from the loop indices
+        void SetSourcePointer(const std::string& pointerName) { _sourcePointer = pointerName; }
+
+        // Access the statements that the tile depends on
+        const MatrixStatementPtr& GetMatrixStatement() const { return _matrixStatement; }
+        const StatementPtr& GetTopStatement() const { return _topStatement; }
+        const StatementPtr& GetLeftStatement() const { return _leftStatement; }
+
     private:
+        std::string GetSourceExpression() const;
+        MatrixLayout GetSourceLayout() const;
+        void PrintCopy(std::ostream& stream, bool copyBack) const;
+        void PrintSharedCopy(std::ostream& stream) const;
+
         MatrixStatementPtr _matrixStatement;
         StatementPtr _topStatement;
         StatementPtr _leftStatement;
+        std::string _sourcePointer;
         bool _cache = false;
+        bool _shared = false;
+    };
+
+    // Scratch statements, which zero a temporary tile that holds an intermediate result of a fused kernel chain
+    class ScratchStatement : public MatrixStatement
+    {
+    public:
+        // Abbreviations
+        using StatementPtr = std::shared_ptr<StatementBase>;
+
+        // Constructor
+        ScratchStatement(const Variable& scratchVariable, MatrixLayout scratchLayout, StatementPtr topStatement, StatementPtr leftStatement);
+
+        // Prints the statement
+        void PrintForward(std::ostream& stream) const override;
+
+        // Sets the position of this statement to be the maximum of its dependencies
+        void SetPositionByDependencies();
+
+        // Access the statements that the scratch tile depends on
+        const StatementPtr& GetTopStatement() const { return _topStatement; }
+        const StatementPtr& GetLeftStatement() const { return _leftStatement; }
+
+    private:
+        StatementPtr _topStatement;
+        StatementPtr _leftStatement;
     };
 
     // Kernel statements
@@ -145,10 +404,69 @@ namespace tiler
         // Prints the statement
         void PrintForward(std::ostream& stream) const override;
 
+        // Access the kernel operands
+        const MatrixStatementPtr& GetMatrixAStatement() const { return _matrixAStatement; }
+        const MatrixStatementPtr& GetMatrixBStatement() const { return _matrixBStatement; }
+        const MatrixStatementPtr& GetMatrixCStatement() const { return _matrixCStatement; }
+
+        // Returns the kernel printing function
+        const KernelType& GetKernel() const { return _kernel; }
+
     private:
         MatrixStatementPtr _matrixAStatement;
         MatrixStatementPtr _matrixBStatement;
         MatrixStatementPtr _matrixCStatement;
         KernelType _kernel;
     };
+
+    // Recursive kernel statements, which halve the largest of M, N, K until the base case of the kernel is reached (A is MxK, B is KxN, C is MxN)
+    class RecursiveKernelStatement : public KernelStatement
+    {
+    public:
+        // Constructor
+        RecursiveKernelStatement(MatrixStatementPtr matrixAStatement, MatrixStatementPtr matrixBStatement, MatrixStatementPtr matrixCStatement, KernelType kernel, int baseM, int baseN, int baseK);
+
+        // Prints the statement
+        void PrintForward(std::ostream& stream) const override;
+
+        // Prints the recursive functions called by the statement
+        void PrintFunctions(std::ostream& stream) const;
+
+        // Tells the recursion to cache an operand at a given recursion depth
+        void AddCache(const Variable& matrixVariable, int depth, MatrixOrder order);
+
+        // Determines which copy functions are required by the cache directives
+        bool RequiresCopy() const;
+        bool RequiresCopyTranspose() const;
+
+        // A request to cache operand 0 (A), 1 (B), or 2 (C) at a recursion depth
+        struct CacheDirective
+        {
+            int operand;
+            int depth;
+            MatrixOrder order;
+        };
+
+        // Access the recursion parameters
+        int GetBaseM() const { return _baseM; }
+        int GetBaseN() const { return _baseN; }
+        int GetBaseK() const { return _baseK; }
+        const std::vector<CacheDirective>& GetCacheDirectives() const { return _cacheDirectives; }
+
+        // Returns the dimension that the recursion halves in a product of size m x n x k (0 for M, 1 for N, 2 for K), and sets
+        // the size of the first half, or returns -1 in a base case
+        int GetSplit(int m, int n, int k, int& firstSize) const;
+
+        // Determines if a cache is allocated on the heap, because it is too large for the stack
+        static bool IsHeapCache(const MatrixLayout& cacheLayout);
+
+    private:
+        std::string PrintRecursion(std::ostream& stream, std::vector<std::string>& signatures, int m, int n, int k, MatrixLayout a, MatrixLayout b, MatrixLayout c, int depth) const;
+        std::string GetFunctionName(int index) const;
+
+        int _baseM;
+        int _baseN;
+        int _baseK;
+        std::vector<CacheDirective> _cacheDirectives;
+    };
 }
\ No newline at end of file
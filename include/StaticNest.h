@@ -0,0 +1,217 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     StaticNest.h
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "MatrixLayout.h"
+
+#include <utility>
+
+// A nest whose shapes are known at build time, written as a C++ type instead of a Nest and specialized by the compiler:
+// loop bounds, tile sizes and layouts are template arguments, offsets are computed by the constexpr MatrixLayout, and
+// kernels are fully unrolled, so the whole nest inlines into its caller. For example, an 8x8x8 tiled product whose A tiles
+// are cached in column-major order:
+//
+//     enum { i, j, k };
+//     using A = StaticUsing<0, 64, 64, MatrixOrder::rowMajor>;
+//     using B = StaticUsing<1, 64, 64, MatrixOrder::rowMajor>;
+//     using C = StaticUsing<2, 64, 64, MatrixOrder::rowMajor, true>;
+//     using AA = StaticCache<3, StaticTile<A, i, k, 8, 8>, MatrixOrder::columnMajor>;
+//     using BB = StaticTile<B, k, j, 8, 8>;
+//     using CC = StaticTile<C, i, j, 8, 8>;
+//
+//     using Gemm = StaticNest<4, 3,
+//         StaticForAll<i, 0, 64, 8,
+//             StaticForAll<k, 0, 64, 8,
+//                 StaticCopy<AA,
+//                     StaticForAll<j, 0, 64, 8,
+//                         StaticKernel<AA, BB, CC>>>>>>;
+//
+//     Gemm::Run(a, b, c);
+//
+// Unlike a Nest, statements are nested explicitly rather than ordered by their indices. Matrices take the slots of the
+// arguments of Run, and caches take the slots that follow them
+namespace tiler
+{
+    // The index of a tile dimension that isn't indexed by a loop, which starts at zero
+    const int staticNoIndex = -1;
+
+    // Returns the value of a loop index
+    template<int index>
+    int GetStaticIndex(const int* indices)
+    {
+        return index == staticNoIndex ? 0 : indices[index];
+    }
+
+    // Runs a sequence of statements
+    template<typename... Statements>
+    void RunStaticStatements(float** slots, int* indices)
+    {
+        int unused[] = { 0, (Statements::Run(slots, indices), 0)... };
+        (void)unused;
+    }
+
+    // A matrix passed to Run in the given slot; a leading dimension of zero means that the matrix is dense
+    template<int slot, int numRows, int numColumns, MatrixOrder order, bool isOutput = false, int leadingDimensionSize = 0>
+    struct StaticUsing
+    {
+        static constexpr bool IsOutput() { return isOutput; }
+        static constexpr MatrixLayout GetLayout() { return leadingDimensionSize == 0 ? MatrixLayout(numRows, numColumns, order) : MatrixLayout(numRows, numColumns, order, leadingDimensionSize); }
+        static float* GetAddress(float** slots, const int*) { return slots[slot]; }
+    };
+
+    // A tile of a matrix, whose top-left element is at the values of two loop indices
+    template<typename Matrix, int rowIndex, int columnIndex, int numRows, int numColumns>
+    struct StaticTile
+    {
+        static_assert(!Matrix::GetLayout().IsBlocked(), "tiles of blocked matrices aren't supported");
+        static_assert(numRows <= Matrix::GetLayout().NumRows() && numColumns <= Matrix::GetLayout().NumColumns(), "tile is larger than its matrix");
+
+        static constexpr bool IsOutput() { return Matrix::IsOutput(); }
+        static constexpr MatrixLayout GetLayout() { return MatrixLayout(numRows, numColumns, Matrix::GetLayout().GetOrder(), Matrix::GetLayout().GetLeadingDimensionSize()); }
+
+        static float* GetAddress(float** slots, const int* indices)
+        {
+            return Matrix::GetAddress(slots, indices) + Matrix::GetLayout()(GetStaticIndex<rowIndex>(indices), GetStaticIndex<columnIndex>(indices));
+        }
+    };
+
+    // A copy of a tile in a new order, in the given slot; it is filled by a StaticCopy statement
+    template<int slot, typename Tile, MatrixOrder order, int blockSize = 1>
+    struct StaticCache
+    {
+        using TileType = Tile;
+
+        static constexpr bool IsOutput() { return Tile::IsOutput(); }
+        static constexpr MatrixLayout GetLayout()
+        {
+            return MatrixLayout(Tile::GetLayout().NumRows(), Tile::GetLayout().NumColumns(), order, (order == MatrixOrder::columnMajor) ? Tile::GetLayout().NumRows() : (Tile::GetLayout().NumColumns() + blockSize - 1) / blockSize * blockSize, blockSize);
+        }
+        static constexpr int GetSlot() { return slot; }
+        static float* GetAddress(float** slots, const int*) { return slots[slot]; }
+    };
+
+    // A loop over an index
+    template<int index, int start, int stop, int step, typename... Statements>
+    struct StaticForAll
+    {
+        static_assert(index >= 0 && step > 0 && (stop - start) % step == 0, "loop must have a positive step that divides its range");
+
+        static void Run(float** slots, int* indices)
+        {
+            for(indices[index] = start; indices[index] < stop; indices[index] += step)
+            {
+                RunStaticStatements<Statements...>(slots, indices);
+            }
+        }
+    };
+
+    // Copies the tile of a cache into a buffer on the stack, runs the statements, and copies outputs back
+    template<typename Cache, typename... Statements>
+    struct StaticCopy
+    {
+        static void Run(float** slots, int* indices)
+        {
+            using Tile = typename Cache::TileType;
+            constexpr auto tileLayout = Tile::GetLayout();
+            constexpr auto cacheLayout = Cache::GetLayout();
+            alignas(64) float buffer[cacheLayout.Size()];
+
+            float* tile = Tile::GetAddress(slots, indices);
+            for(int row = 0; row < tileLayout.NumRows(); ++row)
+            {
+                for(int column = 0; column < tileLayout.NumColumns(); ++column)
+                {
+                    buffer[cacheLayout(row, column)] = tile[tileLayout(row, column)];
+                }
+            }
+
+            slots[Cache::GetSlot()] = buffer;
+            RunStaticStatements<Statements...>(slots, indices);
+
+            if(Cache::IsOutput())
+            {
+                for(int row = 0; row < tileLayout.NumRows(); ++row)
+                {
+                    for(int column = 0; column < tileLayout.NumColumns(); ++column)
+                    {
+                        tile[tileLayout(row, column)] = buffer[cacheLayout(row, column)];
+                    }
+                }
+            }
+        }
+    };
+
+    // C += A * B, fully unrolled: the accumulators are loaded once, updated by one rank-1 product per step of k, and stored.
+    // Every offset is a compile-time constant
+    template<typename MatrixA, typename MatrixB, typename MatrixC>
+    struct StaticKernel
+    {
+        static constexpr int m = MatrixC::GetLayout().NumRows();
+        static constexpr int n = MatrixC::GetLayout().NumColumns();
+        static constexpr int k = MatrixA::GetLayout().NumColumns();
+
+        static_assert(MatrixA::GetLayout().NumRows() == m && MatrixB::GetLayout().NumRows() == k && MatrixB::GetLayout().NumColumns() == n, "kernel matrices have incompatible sizes");
+        static_assert(MatrixC::IsOutput(), "kernel must write to an output");
+
+        static void Run(float** slots, int* indices)
+        {
+            const float* a = MatrixA::GetAddress(slots, indices);
+            const float* b = MatrixB::GetAddress(slots, indices);
+            float* c = MatrixC::GetAddress(slots, indices);
+            float accumulators[m * n];
+
+            Load(accumulators, c, std::make_integer_sequence<int, m * n>());
+            Multiply(accumulators, a, b, std::make_integer_sequence<int, k>());
+            Store(c, accumulators, std::make_integer_sequence<int, m * n>());
+        }
+
+    private:
+        template<int... elements>
+        static void Load(float* accumulators, const float* c, std::integer_sequence<int, elements...>)
+        {
+            int unused[] = { 0, (accumulators[elements] = c[std::integral_constant<int, MatrixC::GetLayout()(elements / n, elements % n)>::value], 0)... };
+            (void)unused;
+        }
+
+        template<int... elements>
+        static void Store(float* c, const float* accumulators, std::integer_sequence<int, elements...>)
+        {
+            int unused[] = { 0, (c[std::integral_constant<int, MatrixC::GetLayout()(elements / n, elements % n)>::value] = accumulators[elements], 0)... };
+            (void)unused;
+        }
+
+        template<int... steps>
+        static void Multiply(float* accumulators, const float* a, const float* b, std::integer_sequence<int, steps...>)
+        {
+            int unused[] = { 0, (MultiplyStep<steps>(accumulators, a, b, std::make_integer_sequence<int, m * n>()), 0)... };
+            (void)unused;
+        }
+
+        template<int step, int... elements>
+        static void MultiplyStep(float* accumulators, const float* a, const float* b, std::integer_sequence<int, elements...>)
+        {
+            int unused[] = { 0, (accumulators[elements] += a[std::integral_constant<int, MatrixA::GetLayout()(elements / n, step)>::value] * b[std::integral_constant<int, MatrixB::GetLayout()(step, elements % n)>::value], 0)... };
+            (void)unused;
+        }
+    };
+
+    // A nest with a number of matrix slots (the arguments of Run followed by the caches) and loop indices
+    template<int numSlots, int numIndices, typename... Statements>
+    struct StaticNest
+    {
+        template<typename... Matrices>
+        static void Run(Matrices*... matrices)
+        {
+            static_assert(sizeof...(Matrices) <= numSlots, "too many matrices for the slots of the nest");
+
+            float* slots[numSlots] = { const_cast<float*>(matrices)... };
+            int indices[numIndices > 0 ? numIndices : 1] = {};
+            RunStaticStatements<Statements...>(slots, indices);
+        }
+    };
+}
@@ -0,0 +1,74 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     Strassen.h
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include "MatrixLayout.h"
+#include "Nest.h"
+#include "Profiler.h"
+#include "Statement.h"
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace tiler
+{
+    // Fast 2x2 block algorithms with 7 sub-products. When the additions are fused into packing, each term of an operand costs a
+    // read of every packed element, so classical Strassen (36 terms) is cheaper than Strassen-Winograd (42 terms once its shared sums are expanded)
+    enum class StrassenVariant { strassen, winograd };
+
+    // Options of the Strassen transform
+    struct StrassenOptions
+    {
+        // a level is applied while M, N, and K are at least the crossover size and even, up to the maximum number of levels
+        int crossover = 4096;
+        int maxLevels = 1;
+
+        // the maximum number of floats in the workspace that holds the combinations that can't be fused into packing
+        long workspaceBound = 1L << 24;
+
+        StrassenVariant variant = StrassenVariant::strassen;
+    };
+
+    // Appends the schedule of the sub-product C += A * B to a nest that defines A, B, and C
+    using SubproductSchedule = std::function<void(NestStatementAppender nest, const Variable& matrixA, const Variable& matrixB, const Variable& matrixC)>;
+
+    // Applies levels of Strassen recursion to C += A * B (A is MxK, B is KxN, C is MxN). Each sub-product is an ordinary nest over
+    // combinations of quadrant views of A, B, and C, which keep the leading dimension of their parent. A combination whose
+    // tiles are all cached is summed as it is packed (and an output combination is added to C as it is unpacked), other
+    // combinations are materialized in the workspace
+    class StrassenNest
+    {
+    public:
+        // Constructor, throws if the workspace exceeds its bound
+        StrassenNest(MatrixLayout layoutA, MatrixLayout layoutB, MatrixLayout layoutC, float* dataA, float* dataB, float* dataC, const SubproductSchedule& schedule, StrassenOptions options = {});
+
+        // Returns the number of levels of recursion, the number of sub-products, and the size of the workspace
+        int NumLevels() const { return _numLevels; }
+        int NumSubproducts() const { return static_cast<int>(_subproducts.size()); }
+        long GetWorkspaceSize() const { return _workspaceSize; }
+
+        // Returns the Using statements of A, B, and C, in that order
+        const UsingStatement& GetOperand(int index) const { return *_operands[index]; }
+
+        // Prints C++ code that implements the transformed product
+        void Print(std::ostream& stream, Instrumentation instrumentation = Instrumentation::none);
+
+    private:
+        std::shared_ptr<Nest> BuildSubproduct(int index, const SubproductSchedule& schedule, const bool materialize[3]);
+
+        StrassenOptions _options;
+        int _numLevels = 0;
+        std::shared_ptr<UsingStatement> _operands[3];
+        std::vector<std::shared_ptr<Nest>> _subproducts;
+        Variable _workspace;
+        long _workspaceOffsets[3] = {0, 0, 0};
+        long _workspaceSize = 0;
+    };
+}
@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     X64Emitter.h
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tiler
+{
+    // General purpose registers, numbered as in the instruction encoding (rsp and r12 can't be memory bases)
+    enum class Gpr { rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r8, r9, r10, r11, r12, r13, r14, r15 };
+
+    // Emits x86-64 machine code into a byte buffer. Memory operands are a base register plus a 32-bit displacement. Float
+    // instructions take vector registers 0-15 and a width of 1 (scalar), 4 (xmm), or 8 (ymm). With VEX encoding they use
+    // AVX2 and FMA, and without it they use SSE, which has no ymm registers or fused multiply-add
+    class X64Emitter
+    {
+    public:
+        // Constructor
+        X64Emitter(bool useVex);
+
+        // Returns the code, and the current position in it, which is a jump target
+        const std::vector<uint8_t>& GetCode() const { return _code; }
+        size_t GetPosition() const { return _code.size(); }
+        bool UsesVex() const { return _useVex; }
+
+        // Integer instructions on 64-bit registers
+        void Push(Gpr reg);
+        void Pop(Gpr reg);
+        void Return();
+        void MoveImmediate(Gpr target, int64_t value);
+        void Move(Gpr target, Gpr source);
+        void Load(Gpr target, Gpr base, int32_t displacement);
+        void Store(Gpr base, int32_t displacement, Gpr source);
+        void AddImmediate(Gpr target, int32_t value);
+        void SubtractImmediate(Gpr target, int32_t value);
+        void Add(Gpr target, Gpr source);
+        void MultiplyImmediate(Gpr target, Gpr source, int32_t value);
+        void CompareImmediate(Gpr reg, int32_t value);
+
+        // Jumps to a position; forward jumps return the position of their displacement, which is patched once the target is known
+        size_t Jump(size_t target = 0);
+        size_t JumpIfLess(size_t target = 0);
+        size_t JumpIfNotZero(size_t target = 0);
+        void PatchJump(size_t displacementPosition, size_t target);
+
+        // Calls the code at a position, which returns with Return, or a function at the address in a register
+        void Call(size_t target);
+        void CallRegister(Gpr reg);
+
+        // Float instructions
+        void LoadFloats(int target, Gpr base, int32_t displacement, int width);
+        void StoreFloats(Gpr base, int32_t displacement, int source, int width);
+        void ZeroFloats(int target);
+        void BroadcastFloat(int target, Gpr base, int32_t displacement, int width);
+        void MultiplyFloat(int target, Gpr base, int32_t displacement);
+        void AddFloat(int target, int source);
+
+        // Adds the product of a register and memory to an accumulator (VEX only)
+        void MultiplyAddFloats(int accumulator, int multiplier, Gpr base, int32_t displacement, int width);
+
+        // Clears the upper halves of the ymm registers before returning to SSE code (VEX only)
+        void ZeroUpper();
+
+    private:
+        void EmitRex(bool wide, int reg, int rm);
+        void EmitMemoryOperand(int reg, Gpr base, int32_t displacement);
+        void EmitRegisterOperand(int reg, int rm);
+        void EmitVex(int map, int prefix, bool wide, bool longVector, int reg, int vvvv, int rm);
+        void EmitSse(int prefix, int opcode, int reg, int rm);
+        size_t EmitJump(int opcode, size_t target);
+        void Emit32(uint32_t value);
+
+        std::vector<uint8_t> _code;
+        bool _useVex;
+    };
+}
@@ -0,0 +1,942 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     CompiledNest.cpp
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "CompiledNest.h"
+#include "X64Emitter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <thread>
+
+namespace tiler
+{
+    InstructionSet GetSupportedInstructionSet()
+    {
+#if defined(__x86_64__)
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return InstructionSet::avx2;
+        }
+#endif
+        return InstructionSet::sse;
+    }
+
+    // One accumulator of a kernel: a vector of elements of C, which adds a broadcast element times a vector for each k. The
+    // offsets are those of k = 0, relative to the pointers of the current group of accumulators
+    struct KernelUnit
+    {
+        int offset;
+        int width;
+        int broadcastOffset;
+        int vectorOffset;
+    };
+
+    // Returns the widths of the vectors that cover a contiguous range of elements
+    std::vector<int> GetVectorWidths(int size, bool useVectors, bool useYmm)
+    {
+        std::vector<int> widths;
+        while(size > 0)
+        {
+            int width = (useYmm && size >= 8) ? 8 : (useVectors && size >= 4) ? 4 : 1;
+            widths.push_back(width);
+            size -= width;
+        }
+        return widths;
+    }
+
+    void CheckLayoutIsSupported(const MatrixStatement& statement)
+    {
+        if(statement.GetLayout().IsBlocked())
+        {
+            throw std::logic_error("the compiled backend does not support the " + GetOrderName(statement.GetLayout().GetOrder()) + " layout of " + statement.GetVariable().GetName());
+        }
+    }
+
+    // Copies count vectors of size floats, from source to target, then advances the pointers by the skips
+    void EmitStridedCopy(X64Emitter& emitter, Gpr target, Gpr source, int size, int count, int targetSkip, int sourceSkip)
+    {
+        int width = emitter.UsesVex() ? 8 : 4;
+        emitter.MoveImmediate(Gpr::r8, count);
+        auto top = emitter.GetPosition();
+        emitter.Move(Gpr::r10, source);
+        emitter.Move(Gpr::r11, target);
+        if(size >= width)
+        {
+            emitter.MoveImmediate(Gpr::r9, size / width);
+            auto inner = emitter.GetPosition();
+            emitter.LoadFloats(0, Gpr::r10, 0, width);
+            emitter.StoreFloats(Gpr::r11, 0, 0, width);
+            emitter.AddImmediate(Gpr::r10, width * 4);
+            emitter.AddImmediate(Gpr::r11, width * 4);
+            emitter.SubtractImmediate(Gpr::r9, 1);
+            emitter.JumpIfNotZero(inner);
+        }
+
+        int offset = 0;
+        for(int remainderWidth : GetVectorWidths(size % width, true, false))
+        {
+            emitter.LoadFloats(0, Gpr::r10, offset * 4, remainderWidth);
+            emitter.StoreFloats(Gpr::r11, offset * 4, 0, remainderWidth);
+            offset += remainderWidth;
+        }
+
+        emitter.AddImmediate(source, sourceSkip * 4);
+        emitter.AddImmediate(target, targetSkip * 4);
+        emitter.SubtractImmediate(Gpr::r8, 1);
+        emitter.JumpIfNotZero(top);
+    }
+
+    // Sets target[i * targetSkip + j] = source[i + j * sourceSkip] for i < count and j < size, like CopyTranspose
+    void EmitTransposedCopy(X64Emitter& emitter, Gpr target, Gpr source, int size, int count, int targetSkip, int sourceSkip)
+    {
+        emitter.MoveImmediate(Gpr::r8, count);
+        auto top = emitter.GetPosition();
+        emitter.Move(Gpr::r10, source);
+        emitter.Move(Gpr::r11, target);
+        emitter.MoveImmediate(Gpr::r9, size);
+        auto inner = emitter.GetPosition();
+        emitter.LoadFloats(0, Gpr::r10, 0, 1);
+        emitter.StoreFloats(Gpr::r11, 0, 0, 1);
+        emitter.AddImmediate(Gpr::r10, sourceSkip * 4);
+        emitter.AddImmediate(Gpr::r11, 4);
+        emitter.SubtractImmediate(Gpr::r9, 1);
+        emitter.JumpIfNotZero(inner);
+
+        emitter.AddImmediate(source, 4);
+        emitter.AddImmediate(target, targetSkip * 4);
+        emitter.SubtractImmediate(Gpr::r8, 1);
+        emitter.JumpIfNotZero(top);
+    }
+
+    void EmitZeroFill(X64Emitter& emitter, Gpr target, int size)
+    {
+        int width = emitter.UsesVex() ? 8 : 4;
+        emitter.ZeroFloats(0);
+        if(size >= width)
+        {
+            emitter.MoveImmediate(Gpr::r9, size / width);
+            auto top = emitter.GetPosition();
+            emitter.StoreFloats(target, 0, 0, width);
+            emitter.AddImmediate(target, width * 4);
+            emitter.SubtractImmediate(Gpr::r9, 1);
+            emitter.JumpIfNotZero(top);
+        }
+
+        int offset = 0;
+        for(int remainderWidth : GetVectorWidths(size % width, true, false))
+        {
+            emitter.StoreFloats(target, offset * 4, 0, remainderWidth);
+            offset += remainderWidth;
+        }
+    }
+
+    // Computes C += A * B with A in rsi, B in rdx, and C in rdi. The accumulators are vectors along a dimension in which C is
+    // contiguous (rows of C and B, or columns of C and A), and each takes one broadcast and one multiply-add per k. The code
+    // is a runtime loop over groups of rows (or columns) of C that fill the accumulator registers, and a runtime loop over k
+    // in each group, unrolled a few times, so its size doesn't grow with the size of the kernel
+    void EmitKernel(X64Emitter& emitter, const MatrixLayout& layoutA, const MatrixLayout& layoutB, const MatrixLayout& layoutC)
+    {
+        int m = layoutC.NumRows();
+        int n = layoutC.NumColumns();
+        int k = layoutA.NumColumns();
+        bool useVectors = emitter.UsesVex();
+        bool isAlongRows = useVectors && layoutC.GetOrder() == MatrixOrder::rowMajor && layoutB.GetOrder() == MatrixOrder::rowMajor;
+        bool isAlongColumns = useVectors && !isAlongRows && layoutC.GetOrder() == MatrixOrder::columnMajor && layoutA.GetOrder() == MatrixOrder::columnMajor;
+        bool isVectorized = isAlongRows || isAlongColumns;
+        int numVectors = isAlongColumns ? n : m;
+        int vectorSize = isAlongColumns ? m : n;
+        if(numVectors == 0 || vectorSize == 0 || k == 0)
+        {
+            return;
+        }
+
+        // the steps, in floats, from one vector of C to the next and from one k to the next
+        int stepC = isAlongColumns ? layoutC(0, 1) : layoutC(1, 0);
+        int broadcastStep = isAlongColumns ? layoutB(0, 1) : layoutA(1, 0);
+        int broadcastStride = isAlongColumns ? layoutB(1, 0) : layoutA(0, 1);
+        int vectorStride = isAlongColumns ? layoutA(0, 1) : layoutB(1, 0);
+        Gpr broadcastBase = isAlongColumns ? Gpr::rdx : Gpr::rsi;
+        Gpr vectorBase = isAlongColumns ? Gpr::rsi : Gpr::rdx;
+
+        // accumulators live in registers 0-11, and registers 12 and 13 hold operands
+        const int numAccumulators = 12;
+        const int maxUnroll = 4;
+        auto widths = GetVectorWidths(vectorSize, isVectorized, isVectorized);
+        int groupSize = std::max(1, numAccumulators / static_cast<int>(widths.size()));
+
+        // emits the multiply-adds of a batch of accumulators for count values of k, from r10 (broadcasts) and r11 (vectors)
+        auto emitSteps = [&](const std::vector<KernelUnit>& batch, int count)
+        {
+            for(int l = 0; l < count; ++l)
+            {
+                // consecutive accumulators in a row of C share their broadcast element
+                int broadcastOffset = -1;
+                int broadcastWidth = 0;
+                for(int index = 0; index < static_cast<int>(batch.size()); ++index)
+                {
+                    const auto& unit = batch[index];
+                    int broadcastDisplacement = (unit.broadcastOffset + l * broadcastStride) * 4;
+                    int vectorDisplacement = (unit.vectorOffset + l * vectorStride) * 4;
+                    if(useVectors)
+                    {
+                        if(unit.broadcastOffset != broadcastOffset || unit.width != broadcastWidth)
+                        {
+                            broadcastOffset = unit.broadcastOffset;
+                            broadcastWidth = unit.width;
+                            emitter.BroadcastFloat(12, Gpr::r10, broadcastDisplacement, unit.width);
+                        }
+                        emitter.MultiplyAddFloats(index, 12, Gpr::r11, vectorDisplacement, unit.width);
+                    }
+                    else
+                    {
+                        emitter.LoadFloats(13, Gpr::r10, broadcastDisplacement, 1);
+                        emitter.MultiplyFloat(13, Gpr::r11, vectorDisplacement);
+                        emitter.AddFloat(index, 13);
+                    }
+                }
+            }
+        };
+
+        // emits the products of a number of vectors of C, from rdi (C) and the broadcast base
+        auto emitGroup = [&](int numGroupVectors)
+        {
+            std::vector<KernelUnit> units;
+            for(int vector = 0; vector < numGroupVectors; ++vector)
+            {
+                int first = 0;
+                for(int width : widths)
+                {
+                    int offset = isAlongColumns ? layoutC(first, vector) : layoutC(vector, first);
+                    int vectorOffset = isAlongColumns ? layoutA(first, 0) : layoutB(0, first);
+                    units.push_back({offset, width, vector * broadcastStep, vectorOffset});
+                    first += width;
+                }
+            }
+
+            for(size_t begin = 0; begin < units.size(); begin += numAccumulators)
+            {
+                std::vector<KernelUnit> batch(units.begin() + begin, units.begin() + std::min(begin + numAccumulators, units.size()));
+                for(int index = 0; index < static_cast<int>(batch.size()); ++index)
+                {
+                    emitter.LoadFloats(index, Gpr::rdi, batch[index].offset * 4, batch[index].width);
+                }
+
+                emitter.Move(Gpr::r10, broadcastBase);
+                emitter.Move(Gpr::r11, vectorBase);
+                int unroll = std::min(k, maxUnroll);
+                if(k >= 2 * unroll)
+                {
+                    emitter.MoveImmediate(Gpr::rcx, k / unroll);
+                    auto top = emitter.GetPosition();
+                    emitSteps(batch, unroll);
+                    emitter.AddImmediate(Gpr::r10, unroll * broadcastStride * 4);
+                    emitter.AddImmediate(Gpr::r11, unroll * vectorStride * 4);
+                    emitter.SubtractImmediate(Gpr::rcx, 1);
+                    emitter.JumpIfNotZero(top);
+                    emitSteps(batch, k % unroll);
+                }
+                else
+                {
+                    emitSteps(batch, k);
+                }
+
+                for(int index = 0; index < static_cast<int>(batch.size()); ++index)
+                {
+                    emitter.StoreFloats(Gpr::rdi, batch[index].offset * 4, index, batch[index].width);
+                }
+            }
+        };
+
+        // whole groups in a runtime loop, then the remaining vectors
+        int numGroups = numVectors / groupSize;
+        if(numGroups > 1)
+        {
+            emitter.MoveImmediate(Gpr::rax, numGroups);
+            auto top = emitter.GetPosition();
+            emitGroup(groupSize);
+            emitter.AddImmediate(Gpr::rdi, groupSize * stepC * 4);
+            emitter.AddImmediate(broadcastBase, groupSize * broadcastStep * 4);
+            emitter.SubtractImmediate(Gpr::rax, 1);
+            emitter.JumpIfNotZero(top);
+        }
+        else if(numGroups == 1)
+        {
+            emitGroup(groupSize);
+            emitter.AddImmediate(Gpr::rdi, groupSize * stepC * 4);
+            emitter.AddImmediate(broadcastBase, groupSize * broadcastStep * 4);
+        }
+
+        if(numVectors % groupSize != 0)
+        {
+            emitGroup(numVectors % groupSize);
+        }
+    }
+
+    CompiledNest::CompiledNest(Nest& nest, InstructionSet instructionSet) : _instructionSet(instructionSet)
+    {
+#if !defined(__x86_64__)
+        throw std::logic_error("the compiled backend requires an x86-64 CPU");
+#endif
+
+        X64Emitter emitter(instructionSet == InstructionSet::avx2);
+
+        // the slots hold the loop indices and the addresses of the matrices, rbx points to them
+        auto emitPrologue = [&]()
+        {
+            emitter.Push(Gpr::rbx);
+            emitter.Push(Gpr::r13);
+            emitter.Push(Gpr::r14);
+            emitter.Push(Gpr::r15);
+            emitter.Move(Gpr::rbx, Gpr::rdi);
+        };
+
+        auto emitEpilogue = [&]()
+        {
+            if(emitter.UsesVex())
+            {
+                emitter.ZeroUpper();
+            }
+            emitter.Pop(Gpr::r15);
+            emitter.Pop(Gpr::r14);
+            emitter.Pop(Gpr::r13);
+            emitter.Pop(Gpr::rbx);
+            emitter.Return();
+        };
+
+        emitPrologue();
+        auto slotDisplacement = [&](const StatementBase& statement) { return GetSlot(statement.GetVariable().GetName()) * 8; };
+
+        // puts the address of the first element of a tile in a register
+        auto emitTileAddress = [&](const TileStatement& tileStatement, Gpr target)
+        {
+            const auto& matrixStatement = *tileStatement.GetMatrixStatement();
+            auto matrixLayout = matrixStatement.GetLayout();
+            emitter.Load(target, Gpr::rbx, slotDisplacement(matrixStatement));
+
+            std::pair<Nest::StatementPtr, int> indices[] = { {tileStatement.GetTopStatement(), matrixLayout(1, 0)}, {tileStatement.GetLeftStatement(), matrixLayout(0, 1)} };
+            for(const auto& index : indices)
+            {
+                if(std::dynamic_pointer_cast<ForAllStatement>(index.first) == nullptr)
+                {
+                    throw std::logic_error("the compiled backend requires tile " + tileStatement.GetVariable().GetName() + " to be indexed by loops");
+                }
+                emitter.Load(Gpr::rcx, Gpr::rbx, slotDisplacement(*index.first));
+                emitter.MultiplyImmediate(Gpr::rcx, Gpr::rcx, index.second * 4);
+                emitter.Add(target, Gpr::rcx);
+            }
+        };
+
+        // packs the tiles of a cached tile statement of a constant matrix into the arena, and points the tile at its packed copy
+        int arenaSize = 0;
+        auto emitPackedTile = [&](const TileStatement& tileStatement)
+        {
+            auto matrixStatement = std::dynamic_pointer_cast<UsingStatement>(tileStatement.GetMatrixStatement());
+            auto topLoop = std::dynamic_pointer_cast<ForAllStatement>(tileStatement.GetTopStatement());
+            auto leftLoop = std::dynamic_pointer_cast<ForAllStatement>(tileStatement.GetLeftStatement());
+            if(matrixStatement == nullptr || !matrixStatement->IsConstant() || topLoop == nullptr || leftLoop == nullptr || topLoop == leftLoop)
+            {
+                return false;
+            }
+
+            auto tileLayout = tileStatement.GetLayout();
+            auto matrixLayout = matrixStatement->GetLayout();
+            int tileSize = tileLayout.Size();
+            int numTops = (topLoop->GetStop() - topLoop->GetStart() + topLoop->GetStep() - 1) / topLoop->GetStep();
+            int numLefts = (leftLoop->GetStop() - leftLoop->GetStart() + leftLoop->GetStep() - 1) / leftLoop->GetStep();
+            bool isInside = topLoop->GetStart() >= 0 && leftLoop->GetStart() >= 0
+                && topLoop->GetStart() + (numTops - 1) * topLoop->GetStep() + tileLayout.NumRows() <= matrixLayout.NumRows()
+                && leftLoop->GetStart() + (numLefts - 1) * leftLoop->GetStep() + tileLayout.NumColumns() <= matrixLayout.NumColumns();
+
+            // the address of a packed tile is linear in the loop indices if the steps divide the distances between packed tiles
+            if(numTops <= 0 || numLefts <= 0 || !isInside || (numLefts * tileSize) % topLoop->GetStep() != 0 || tileSize % leftLoop->GetStep() != 0)
+            {
+                return false;
+            }
+
+            auto paddedStatement = std::dynamic_pointer_cast<PaddedUsingStatement>(matrixStatement);
+            auto dataLayout = paddedStatement != nullptr ? paddedStatement->GetDataLayout() : matrixLayout;
+            int slot = GetSlot(tileStatement.GetVariable().GetName() + "_packed");
+            _packedTiles.push_back({matrixStatement->GetData(), dataLayout, tileLayout, topLoop->GetStart(), numTops, topLoop->GetStep(), leftLoop->GetStart(), numLefts, leftLoop->GetStep(), arenaSize, slot});
+            arenaSize += (numTops * numLefts * tileSize + 15) / 16 * 16;
+
+            std::pair<Nest::StatementPtr, int> indices[] = { {topLoop, numLefts * tileSize / topLoop->GetStep()}, {leftLoop, tileSize / leftLoop->GetStep()} };
+            emitter.Load(Gpr::rsi, Gpr::rbx, slot * 8);
+            for(const auto& index : indices)
+            {
+                emitter.Load(Gpr::rcx, Gpr::rbx, slotDisplacement(*index.first));
+                emitter.MultiplyImmediate(Gpr::rcx, Gpr::rcx, index.second * 4);
+                emitter.Add(Gpr::rsi, Gpr::rcx);
+            }
+            emitter.Store(Gpr::rbx, slotDisplacement(tileStatement), Gpr::rsi);
+            return true;
+        };
+
+        // emits the function of a node of a recursive kernel, after the functions of its halves, and returns its position. A
+        // function takes A, B, and C in r13, r14, and r15, and clobbers every register but rbx. Like the printed functions, a
+        // function is shared by the nodes with the same shape, layouts, and depth, and the caches of a depth share a buffer
+        std::map<std::string, size_t> recursionFunctions;
+        std::map<int, int> recursionCacheSizes;
+
+        // the sizes of the buffers that each thread of the parallel loop needs its own copy of, by slot
+        std::map<int, int> privateSizes;
+        bool isInParallelLoop = false;
+        std::function<size_t(const RecursiveKernelStatement&, int, int, int, std::vector<MatrixLayout>, int)> emitRecursion;
+        emitRecursion = [&](const RecursiveKernelStatement& kernelStatement, int m, int n, int k, std::vector<MatrixLayout> layouts, int depth)
+        {
+            const Gpr registers[] = { Gpr::r13, Gpr::r14, Gpr::r15 };
+            auto sourceLayouts = layouts;
+            int cacheSlots[] = { -1, -1, -1 };
+            auto kernelName = kernelStatement.GetVariable().GetName();
+            for(const auto& directive : kernelStatement.GetCacheDirectives())
+            {
+                if(directive.depth == depth)
+                {
+                    auto& layout = layouts[directive.operand];
+                    layout = GetPaddedLayout(MatrixLayout(layout.NumRows(), layout.NumColumns(), directive.order));
+                    cacheSlots[directive.operand] = GetSlot(kernelName + "_cache" + std::to_string(depth) + "_" + std::to_string(directive.operand));
+                    auto& cacheSize = recursionCacheSizes[cacheSlots[directive.operand]];
+                    cacheSize = std::max(cacheSize, layout.Size());
+                    if(isInParallelLoop)
+                    {
+                        privateSizes[cacheSlots[directive.operand]] = 0;
+                    }
+                }
+            }
+
+            std::string signature = kernelName + "," + std::to_string(m) + "," + std::to_string(n) + "," + std::to_string(k) + "," + std::to_string(depth);
+            for(const auto& layout : layouts)
+            {
+                signature += "," + GetOrderName(layout.GetOrder()) + "," + std::to_string(layout.GetLeadingDimensionSize());
+            }
+
+            auto iter = recursionFunctions.find(signature);
+            if(iter != recursionFunctions.end())
+            {
+                return iter->second;
+            }
+
+            // the halves, and the offsets of the operands of the second half
+            auto subLayout = [](const MatrixLayout& layout, int numRows, int numColumns) { return MatrixLayout(numRows, numColumns, layout.GetOrder(), layout.GetLeadingDimensionSize()); };
+            const auto& la = layouts[0];
+            const auto& lb = layouts[1];
+            const auto& lc = layouts[2];
+            int firstSize = 0;
+            int split = kernelStatement.GetSplit(m, n, k, firstSize);
+            std::vector<size_t> calls;
+            std::vector<int> offsets(3, 0);
+            if(split == 0)
+            {
+                calls.push_back(emitRecursion(kernelStatement, firstSize, n, k, {subLayout(la, firstSize, k), subLayout(lb, k, n), subLayout(lc, firstSize, n)}, depth + 1));
+                calls.push_back(emitRecursion(kernelStatement, m - firstSize, n, k, {subLayout(la, m - firstSize, k), subLayout(lb, k, n), subLayout(lc, m - firstSize, n)}, depth + 1));
+                offsets = { la(firstSize, 0), 0, lc(firstSize, 0) };
+            }
+            else if(split == 1)
+            {
+                calls.push_back(emitRecursion(kernelStatement, m, firstSize, k, {subLayout(la, m, k), subLayout(lb, k, firstSize), subLayout(lc, m, firstSize)}, depth + 1));
+                calls.push_back(emitRecursion(kernelStatement, m, n - firstSize, k, {subLayout(la, m, k), subLayout(lb, k, n - firstSize), subLayout(lc, m, n - firstSize)}, depth + 1));
+                offsets = { 0, lb(0, firstSize), lc(0, firstSize) };
+            }
+            else if(split == 2)
+            {
+                calls.push_back(emitRecursion(kernelStatement, m, n, firstSize, {subLayout(la, m, firstSize), subLayout(lb, firstSize, n), subLayout(lc, m, n)}, depth + 1));
+                calls.push_back(emitRecursion(kernelStatement, m, n, k - firstSize, {subLayout(la, m, k - firstSize), subLayout(lb, k - firstSize, n), subLayout(lc, m, n)}, depth + 1));
+                offsets = { la(0, firstSize), lb(firstSize, 0), 0 };
+            }
+
+            auto position = emitter.GetPosition();
+            recursionFunctions[signature] = position;
+
+            // copy the cached operands, and keep the address of C in the stack for the copy back
+            for(int operand = 0; operand < 3; ++operand)
+            {
+                if(cacheSlots[operand] < 0)
+                {
+                    continue;
+                }
+
+                const auto& source = sourceLayouts[operand];
+                const auto& cache = layouts[operand];
+                if(operand == 2)
+                {
+                    emitter.Push(registers[operand]);
+                }
+                emitter.Move(Gpr::rsi, registers[operand]);
+                emitter.Load(Gpr::rdi, Gpr::rbx, cacheSlots[operand] * 8);
+                if(source.GetOrder() == cache.GetOrder())
+                {
+                    EmitStridedCopy(emitter, Gpr::rdi, Gpr::rsi, cache.GetMinorSize(), cache.GetMajorSize(), cache.GetLeadingDimensionSize(), source.GetLeadingDimensionSize());
+                }
+                else
+                {
+                    EmitTransposedCopy(emitter, Gpr::rdi, Gpr::rsi, cache.GetMinorSize(), cache.GetMajorSize(), cache.GetLeadingDimensionSize(), source.GetLeadingDimensionSize());
+                }
+                emitter.Load(registers[operand], Gpr::rbx, cacheSlots[operand] * 8);
+            }
+
+            if(calls.empty())
+            {
+                // base case, where the kernel checks its operands as it prints itself
+                std::ostream nullStream(nullptr);
+                UsingStatement matrixA(kernelStatement.GetMatrixAStatement()->GetVariable(), la, false, nullptr);
+                UsingStatement matrixB(kernelStatement.GetMatrixBStatement()->GetVariable(), lb, false, nullptr);
+                UsingStatement matrixC(kernelStatement.GetMatrixCStatement()->GetVariable(), lc, true, nullptr);
+                kernelStatement.GetKernel()(nullStream, matrixA, matrixB, matrixC);
+
+                emitter.Move(Gpr::rsi, Gpr::r13);
+                emitter.Move(Gpr::rdx, Gpr::r14);
+                emitter.Move(Gpr::rdi, Gpr::r15);
+                EmitKernel(emitter, la, lb, lc);
+            }
+
+            for(size_t call = 0; call < calls.size(); ++call)
+            {
+                for(auto reg : registers)
+                {
+                    emitter.Push(reg);
+                }
+                for(int operand = 0; operand < 3 && call > 0; ++operand)
+                {
+                    if(offsets[operand] != 0)
+                    {
+                        emitter.AddImmediate(registers[operand], offsets[operand] * 4);
+                    }
+                }
+                emitter.Call(calls[call]);
+                for(int operand = 2; operand >= 0; --operand)
+                {
+                    emitter.Pop(registers[operand]);
+                }
+            }
+
+            if(cacheSlots[2] >= 0)
+            {
+                // copy the output value back from the cache
+                const auto& source = sourceLayouts[2];
+                const auto& cache = layouts[2];
+                emitter.Pop(Gpr::rdi);
+                emitter.Load(Gpr::rsi, Gpr::rbx, cacheSlots[2] * 8);
+                if(source.GetOrder() == cache.GetOrder())
+                {
+                    EmitStridedCopy(emitter, Gpr::rdi, Gpr::rsi, cache.GetMinorSize(), cache.GetMajorSize(), source.GetLeadingDimensionSize(), cache.GetLeadingDimensionSize());
+                }
+                else
+                {
+                    EmitTransposedCopy(emitter, Gpr::rdi, Gpr::rsi, cache.GetMajorSize(), cache.GetMinorSize(), source.GetLeadingDimensionSize(), cache.GetLeadingDimensionSize());
+                }
+            }
+
+            emitter.Return();
+            return position;
+        };
+
+        // the top of each open loop, and the jump that skips a loop without iterations
+        std::map<const StatementBase*, std::pair<size_t, size_t>> loopJumps;
+        const size_t noJump = static_cast<size_t>(-1);
+
+        auto enter = [&](const Nest::StatementPtr& statement)
+        {
+            auto name = statement->GetVariable().GetName();
+            auto constantStatement = std::dynamic_pointer_cast<UsingStatement>(statement);
+            if(constantStatement != nullptr && constantStatement->IsConstant() && constantStatement->GetData() == nullptr)
+            {
+                throw std::logic_error("constant matrix " + name + " has no data to pack");
+            }
+
+            if(std::dynamic_pointer_cast<CombinationUsingStatement>(statement) != nullptr || std::dynamic_pointer_cast<MappedUsingStatement>(statement) != nullptr || std::dynamic_pointer_cast<BlockSparseUsingStatement>(statement) != nullptr)
+            {
+                throw std::logic_error("the compiled backend does not support the Using statement of " + name);
+            }
+            else if(auto paddedStatement = std::dynamic_pointer_cast<PaddedUsingStatement>(statement))
+            {
+                // constant matrices are copied when they are packed, and others on every run
+                auto buffer = AllocateBuffer(paddedStatement->GetLayout().Size());
+                _slots[GetSlot(name)] = reinterpret_cast<int64_t>(buffer);
+                PaddedCopy copy = {name, paddedStatement->GetData(), paddedStatement->GetDataLayout(), buffer, paddedStatement->GetLayout()};
+                if(paddedStatement->IsConstant())
+                {
+                    _constantCopies.push_back(copy);
+                }
+                else
+                {
+                    _paddedCopies.push_back(copy);
+                    _boundMatrices.insert(name);
+                }
+            }
+            else if(auto usingStatement = std::dynamic_pointer_cast<UsingStatement>(statement))
+            {
+                // caches, scratch tiles, and matrices without data get their own buffers
+                CheckLayoutIsSupported(*usingStatement);
+                auto data = usingStatement->GetData();
+                _slots[GetSlot(name)] = reinterpret_cast<int64_t>(data != nullptr ? data : AllocateBuffer(usingStatement->GetLayout().Size()));
+                if(data == nullptr && isInParallelLoop)
+                {
+                    privateSizes[GetSlot(name)] = usingStatement->GetLayout().Size();
+                }
+                if(data != nullptr && !usingStatement->IsConstant())
+                {
+                    _boundMatrices.insert(name);
+                }
+            }
+            else if(auto loop = std::dynamic_pointer_cast<ForAllStatement>(statement))
+            {
+                if(loop->IsParallel())
+                {
+                    if(loop->IsLockstep() || !loop->GetPartialNames().empty())
+                    {
+                        throw std::logic_error("the compiled backend does not support parallel loop " + name + ", which shares caches or splits outputs");
+                    }
+
+                    // the body is a function behind a jump, which runs the iteration in the slot of the loop
+                    auto skipJump = emitter.Jump();
+                    _parallelLoop.reset(new ParallelLoop{emitter.GetPosition(), GetSlot(name), loop->GetStart(), loop->GetStop(), loop->GetStep(), {}, {}});
+                    loopJumps[loop.get()] = {skipJump, noJump};
+                    emitPrologue();
+                    isInParallelLoop = true;
+                    return;
+                }
+
+                emitter.MoveImmediate(Gpr::rax, loop->GetStart());
+                emitter.Store(Gpr::rbx, slotDisplacement(*loop), Gpr::rax);
+                auto skipJump = loop->GetStart() < loop->GetStop() ? noJump : emitter.Jump();
+                loopJumps[loop.get()] = {emitter.GetPosition(), skipJump};
+            }
+            else if(auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement))
+            {
+                CheckLayoutIsSupported(*tileStatement);
+                CheckLayoutIsSupported(*tileStatement->GetMatrixStatement());
+                if(tileStatement->IsCached() && emitPackedTile(*tileStatement))
+                {
+                    return;
+                }
+
+                emitTileAddress(*tileStatement, Gpr::rsi);
+                if(!tileStatement->IsCached())
+                {
+                    emitter.Store(Gpr::rbx, slotDisplacement(*tileStatement), Gpr::rsi);
+                    return;
+                }
+
+                auto tileLayout = tileStatement->GetLayout();
+                auto matrixLayout = tileStatement->GetMatrixStatement()->GetLayout();
+                emitter.Load(Gpr::rdi, Gpr::rbx, slotDisplacement(*tileStatement));
+                if(tileStatement->IsTransposed())
+                {
+                    EmitTransposedCopy(emitter, Gpr::rdi, Gpr::rsi, tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), tileLayout.GetLeadingDimensionSize(), matrixLayout.GetLeadingDimensionSize());
+                }
+                else
+                {
+                    EmitStridedCopy(emitter, Gpr::rdi, Gpr::rsi, tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), tileLayout.GetLeadingDimensionSize(), matrixLayout.GetLeadingDimensionSize());
+                }
+            }
+            else if(auto scratchStatement = std::dynamic_pointer_cast<ScratchStatement>(statement))
+            {
+                emitter.Load(Gpr::rdi, Gpr::rbx, slotDisplacement(*scratchStatement));
+                EmitZeroFill(emitter, Gpr::rdi, scratchStatement->GetLayout().Size());
+            }
+            else if(auto recursiveStatement = std::dynamic_pointer_cast<RecursiveKernelStatement>(statement))
+            {
+                // the functions of the recursion are emitted in place, behind a jump
+                const auto& matrixA = *recursiveStatement->GetMatrixAStatement();
+                const auto& matrixB = *recursiveStatement->GetMatrixBStatement();
+                const auto& matrixC = *recursiveStatement->GetMatrixCStatement();
+                auto skipJump = emitter.Jump();
+                auto function = emitRecursion(*recursiveStatement, matrixC.GetLayout().NumRows(), matrixC.GetLayout().NumColumns(), matrixA.GetLayout().NumColumns(), {matrixA.GetLayout(), matrixB.GetLayout(), matrixC.GetLayout()}, 0);
+                emitter.PatchJump(skipJump, emitter.GetPosition());
+
+                emitter.Load(Gpr::r13, Gpr::rbx, slotDisplacement(matrixA));
+                emitter.Load(Gpr::r14, Gpr::rbx, slotDisplacement(matrixB));
+                emitter.Load(Gpr::r15, Gpr::rbx, slotDisplacement(matrixC));
+                emitter.Call(function);
+            }
+            else if(auto kernelStatement = std::dynamic_pointer_cast<KernelStatement>(statement))
+            {
+                // the kernel checks its operands as it prints itself
+                std::ostream nullStream(nullptr);
+                const auto& matrixA = *kernelStatement->GetMatrixAStatement();
+                const auto& matrixB = *kernelStatement->GetMatrixBStatement();
+                const auto& matrixC = *kernelStatement->GetMatrixCStatement();
+                kernelStatement->GetKernel()(nullStream, matrixA, matrixB, matrixC);
+
+                emitter.Load(Gpr::rsi, Gpr::rbx, slotDisplacement(matrixA));
+                emitter.Load(Gpr::rdx, Gpr::rbx, slotDisplacement(matrixB));
+                emitter.Load(Gpr::rdi, Gpr::rbx, slotDisplacement(matrixC));
+                EmitKernel(emitter, matrixA.GetLayout(), matrixB.GetLayout(), matrixC.GetLayout());
+            }
+            else
+            {
+                throw std::logic_error("the compiled backend does not support the statement of " + name);
+            }
+        };
+
+        auto exit = [&](const Nest::StatementPtr& statement)
+        {
+            if(auto loop = std::dynamic_pointer_cast<ForAllStatement>(statement))
+            {
+                auto jumps = loopJumps.at(loop.get());
+                if(loop->IsParallel())
+                {
+                    emitEpilogue();
+                    emitter.PatchJump(jumps.first, emitter.GetPosition());
+                    isInParallelLoop = false;
+
+                    // calls RunParallelLoop(this, slots), after aligning the stack, which is 8 bytes past 16 after the four pushes
+                    emitter.SubtractImmediate(Gpr::rsp, 8);
+                    emitter.MoveImmediate(Gpr::rdi, reinterpret_cast<int64_t>(this));
+                    emitter.Move(Gpr::rsi, Gpr::rbx);
+                    emitter.MoveImmediate(Gpr::rax, reinterpret_cast<int64_t>(&CompiledNest::RunParallelLoop));
+                    emitter.CallRegister(Gpr::rax);
+                    emitter.AddImmediate(Gpr::rsp, 8);
+                    return;
+                }
+
+                emitter.Load(Gpr::rax, Gpr::rbx, slotDisplacement(*loop));
+                emitter.AddImmediate(Gpr::rax, loop->GetStep());
+                emitter.Store(Gpr::rbx, slotDisplacement(*loop), Gpr::rax);
+                emitter.CompareImmediate(Gpr::rax, loop->GetStop());
+                emitter.JumpIfLess(jumps.first);
+                if(jumps.second != noJump)
+                {
+                    emitter.PatchJump(jumps.second, emitter.GetPosition());
+                }
+            }
+            else if(auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement))
+            {
+                if(!tileStatement->IsCached() || !tileStatement->IsOutput())
+                {
+                    return;
+                }
+
+                // copy the output back from the cache
+                auto tileLayout = tileStatement->GetLayout();
+                auto matrixLayout = tileStatement->GetMatrixStatement()->GetLayout();
+                emitTileAddress(*tileStatement, Gpr::rdi);
+                emitter.Load(Gpr::rsi, Gpr::rbx, slotDisplacement(*tileStatement));
+                if(tileStatement->IsTransposed())
+                {
+                    EmitTransposedCopy(emitter, Gpr::rdi, Gpr::rsi, tileLayout.GetMajorSize(), tileLayout.GetMinorSize(), matrixLayout.GetLeadingDimensionSize(), tileLayout.GetLeadingDimensionSize());
+                }
+                else
+                {
+                    EmitStridedCopy(emitter, Gpr::rdi, Gpr::rsi, tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), matrixLayout.GetLeadingDimensionSize(), tileLayout.GetLeadingDimensionSize());
+                }
+            }
+        };
+
+        Nest::Traverse(nest.GetOrderedStatements(), enter, exit);
+
+        for(const auto& cacheSize : recursionCacheSizes)
+        {
+            _slots[cacheSize.first] = reinterpret_cast<int64_t>(AllocateBuffer(cacheSize.second));
+            if(privateSizes.count(cacheSize.first) > 0)
+            {
+                privateSizes[cacheSize.first] = cacheSize.second;
+            }
+        }
+
+        // the first thread of the parallel loop uses the buffers in the slots, and each other thread gets its own
+        if(_parallelLoop != nullptr)
+        {
+            int numIterations = std::max((_parallelLoop->stop - _parallelLoop->start + _parallelLoop->step - 1) / _parallelLoop->step, 0);
+            int numThreads = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()), numIterations));
+            _parallelLoop->threadBuffers.resize(numThreads);
+            for(const auto& privateSize : privateSizes)
+            {
+                _parallelLoop->privateSlots.push_back(privateSize.first);
+                for(int thread = 0; thread < numThreads; ++thread)
+                {
+                    _parallelLoop->threadBuffers[thread].push_back(thread == 0 ? reinterpret_cast<float*>(_slots[privateSize.first]) : AllocateBuffer(privateSize.second));
+                }
+            }
+        }
+
+        // the slot of each packed tile statement points to where its tile at index zero would be
+        if(arenaSize > 0)
+        {
+            _arena = AllocateBuffer(arenaSize);
+        }
+        for(const auto& packedTile : _packedTiles)
+        {
+            int tileSize = packedTile.tileLayout.Size();
+            auto origin = static_cast<int64_t>(packedTile.topStart) * (packedTile.numLefts * tileSize / packedTile.topStep) + static_cast<int64_t>(packedTile.leftStart) * (tileSize / packedTile.leftStep);
+            _slots[packedTile.slot] = reinterpret_cast<int64_t>(_arena + packedTile.offset) - origin * 4;
+        }
+
+        emitEpilogue();
+
+        // copy the code to a buffer that is made executable once it is written
+        const auto& code = emitter.GetCode();
+        _codeSize = code.size();
+        _code = mmap(nullptr, _codeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(_code == MAP_FAILED)
+        {
+            _code = nullptr;
+            throw std::logic_error("failed to allocate a buffer for the compiled code");
+        }
+
+        std::memcpy(_code, code.data(), _codeSize);
+        if(mprotect(_code, _codeSize, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(_code, _codeSize);
+            _code = nullptr;
+            throw std::logic_error("failed to make the compiled code executable");
+        }
+
+        Invalidate();
+    }
+
+    CompiledNest::~CompiledNest()
+    {
+        if(_code != nullptr)
+        {
+            munmap(_code, _codeSize);
+        }
+    }
+
+    void CompiledNest::Run()
+    {
+        // a matrix without data keeps the contents of its buffer
+        for(const auto& copy : _paddedCopies)
+        {
+            if(copy.data != nullptr)
+            {
+                ConvertLayout(copy.data, copy.dataLayout, copy.buffer, copy.layout);
+            }
+        }
+
+        auto function = reinterpret_cast<void (*)(int64_t*)>(_code);
+        function(_slots.data());
+    }
+
+    void CompiledNest::SetMatrix(const Variable& variable, float* data)
+    {
+        auto name = variable.GetName();
+        if(_boundMatrices.count(name) == 0)
+        {
+            throw std::logic_error("matrix " + name + " is not an input or output of the compiled nest that can be bound");
+        }
+
+        for(auto& copy : _paddedCopies)
+        {
+            if(copy.name == name)
+            {
+                copy.data = data;
+                return;
+            }
+        }
+        _slots[_slotIndices.at(name)] = reinterpret_cast<int64_t>(data);
+    }
+
+    void CompiledNest::Invalidate()
+    {
+        for(const auto& copy : _constantCopies)
+        {
+            if(copy.data != nullptr)
+            {
+                ConvertLayout(copy.data, copy.dataLayout, copy.buffer, copy.layout);
+            }
+        }
+
+        for(const auto& packedTile : _packedTiles)
+        {
+            const auto& tileLayout = packedTile.tileLayout;
+            float* target = _arena + packedTile.offset;
+            for(int topIndex = 0; topIndex < packedTile.numTops; ++topIndex)
+            {
+                for(int leftIndex = 0; leftIndex < packedTile.numLefts; ++leftIndex)
+                {
+                    int top = packedTile.topStart + topIndex * packedTile.topStep;
+                    int left = packedTile.leftStart + leftIndex * packedTile.leftStep;
+                    for(int row = 0; row < tileLayout.NumRows(); ++row)
+                    {
+                        for(int column = 0; column < tileLayout.NumColumns(); ++column)
+                        {
+                            target[tileLayout(row, column)] = packedTile.data[packedTile.dataLayout(top + row, left + column)];
+                        }
+                    }
+                    target += tileLayout.Size();
+                }
+            }
+        }
+    }
+
+    void CompiledNest::RunParallelLoop(CompiledNest* compiledNest, const int64_t* slots)
+    {
+        // like the printed ParallelFor, each thread runs a contiguous range of iterations
+        const auto& loop = *compiledNest->_parallelLoop;
+        auto body = reinterpret_cast<void (*)(int64_t*)>(static_cast<uint8_t*>(compiledNest->_code) + loop.bodyPosition);
+        int numThreads = static_cast<int>(loop.threadBuffers.size());
+        int numIterations = std::max((loop.stop - loop.start + loop.step - 1) / loop.step, 0);
+        size_t numSlots = compiledNest->_slots.size();
+
+        std::vector<std::thread> threads;
+        for(int thread = 0; thread < numThreads; ++thread)
+        {
+            int first = static_cast<int>(static_cast<long>(numIterations) * thread / numThreads);
+            int last = static_cast<int>(static_cast<long>(numIterations) * (thread + 1) / numThreads);
+            threads.emplace_back([=, &loop]()
+            {
+                std::vector<int64_t> threadSlots(slots, slots + numSlots);
+                for(size_t index = 0; index < loop.privateSlots.size(); ++index)
+                {
+                    threadSlots[loop.privateSlots[index]] = reinterpret_cast<int64_t>(loop.threadBuffers[thread][index]);
+                }
+
+                for(int iteration = first; iteration < last; ++iteration)
+                {
+                    threadSlots[loop.slot] = loop.start + iteration * loop.step;
+                    body(threadSlots.data());
+                }
+            });
+        }
+
+        for(auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    float* CompiledNest::GetMatrix(const Variable& variable) const
+    {
+        auto iter = _slotIndices.find(variable.GetName());
+        if(iter == _slotIndices.end())
+        {
+            throw std::logic_error("matrix " + variable.GetName() + " is not part of the compiled nest");
+        }
+        return reinterpret_cast<float*>(_slots[iter->second]);
+    }
+
+    int CompiledNest::GetSlot(const std::string& name)
+    {
+        auto iter = _slotIndices.find(name);
+        if(iter != _slotIndices.end())
+        {
+            return iter->second;
+        }
+
+        _slots.push_back(0);
+        return _slotIndices[name] = static_cast<int>(_slots.size()) - 1;
+    }
+
+    float* CompiledNest::AllocateBuffer(int size)
+    {
+        // buffers are aligned to cache lines and start at zero
+        auto buffer = static_cast<float*>(aligned_alloc(64, (size * sizeof(float) + 63) / 64 * 64));
+        std::fill_n(buffer, size, 0.0f);
+        _buffers.emplace_back(buffer);
+        return buffer;
+    }
+
+    void CompiledNest::BufferDeleter::operator()(float* buffer) const
+    {
+        free(buffer);
+    }
+}
@@ -49,5 +49,172 @@ namespace tiler
         PrintFormated(stream, "(*(%+%)) += (*(%+%)) * (*(%+%)) + (*(%+%)) * (*(%+%));\n", C, c(1,0), A, a(1,0), B, b(0,0), A, a(1,1), B, b(1,0));
         stream << Indent;
         PrintFormated(stream, "(*(%+%)) += (*(%+%)) * (*(%+%)) + (*(%+%)) * (*(%+%));\n", C, c(1,1), A, a(1,0), B, b(0,1), A, a(1,1), B, b(1,1));
-    } 
+    }
+
+    // the number of partial sums of each dot product, a vector of floats, and the widest B of a matrix-vector kernel
+    const int dotProductLanes = 8;
+    const int maxMatrixVectorColumns = 8;
+
+    // Returns the distance between consecutive rows and between consecutive columns of a row-major or column-major layout
+    int GetRowStride(const MatrixLayout& layout) { return layout(1, 0) - layout(0, 0); }
+    int GetColumnStride(const MatrixLayout& layout) { return layout(0, 1) - layout(0, 0); }
+
+    void MVKernel(std::ostream& stream, const MatrixStatement& matrixA, const MatrixStatement& matrixB, const MatrixStatement& matrixC)
+    {
+        auto a = matrixA.GetLayout();
+        auto b = matrixB.GetLayout();
+        auto c = matrixC.GetLayout();
+
+        if(a.IsBlocked() || b.IsBlocked() || c.IsBlocked())
+        {
+            throw std::logic_error("matrix-vector kernel requires row-major or column-major matrices");
+        }
+
+        if(b.NumColumns() > maxMatrixVectorColumns)
+        {
+            throw std::logic_error("matrix B incompatible with kernel requirements");
+        }
+
+        if(a.NumRows() != c.NumRows() || b.NumColumns() != c.NumColumns() || a.NumColumns() != b.NumRows())
+        {
+            throw std::logic_error("matrices of matrix-vector kernel have incompatible sizes");
+        }
+
+        auto A = matrixA.GetVariable().GetName();
+        auto B = matrixB.GetVariable().GetName();
+        auto C = matrixC.GetVariable().GetName();
+        int m = c.NumRows();
+        int n = c.NumColumns();
+        int k = a.NumColumns();
+
+        stream << Indent;
+        if(a.GetOrder() == MatrixOrder::rowMajor)
+        {
+            // each row of A is read once, by one dot product per column of B, whose partial sums fill a vector
+            int vectorK = k / dotProductLanes * dotProductLanes;
+            PrintFormated(stream, "for(int i = 0; i < %; ++i)    // %x%x% matrix-vector kernel, dot products along the rows of A\n", m, m, k, n);
+            stream << Indent << "{\n";
+            IncreaseIndent();
+            stream << Indent;
+            PrintFormated(stream, "const float* a = % + i * %;\n", A, GetRowStride(a));
+            stream << Indent;
+            PrintFormated(stream, "float sums[%][%] = {};\n", n, dotProductLanes);
+            if(vectorK > 0)
+            {
+                stream << Indent;
+                PrintFormated(stream, "for(int k = 0; k < %; k += %)\n", vectorK, dotProductLanes);
+                stream << Indent << "{\n";
+                IncreaseIndent();
+                stream << Indent;
+                PrintFormated(stream, "for(int l = 0; l < %; ++l)\n", dotProductLanes);
+                stream << Indent << "{\n";
+                IncreaseIndent();
+                for(int j = 0; j < n; ++j)
+                {
+                    stream << Indent;
+                    PrintFormated(stream, "sums[%][l] += a[k + l] * %[(k + l) * % + %];\n", j, B, GetRowStride(b), j * GetColumnStride(b));
+                }
+                DecreaseIndent();
+                stream << Indent << "}\n";
+                DecreaseIndent();
+                stream << Indent << "}\n";
+            }
+            if(vectorK < k)
+            {
+                stream << Indent;
+                PrintFormated(stream, "for(int k = %; k < %; ++k)\n", vectorK, k);
+                stream << Indent << "{\n";
+                IncreaseIndent();
+                for(int j = 0; j < n; ++j)
+                {
+                    stream << Indent;
+                    PrintFormated(stream, "sums[%][0] += a[k] * %[k * % + %];\n", j, B, GetRowStride(b), j * GetColumnStride(b));
+                }
+                DecreaseIndent();
+                stream << Indent << "}\n";
+            }
+            for(int j = 0; j < n; ++j)
+            {
+                stream << Indent;
+                PrintFormated(stream, "%[i * % + %] += sums[%][0]", C, GetRowStride(c), j * GetColumnStride(c), j);
+                for(int lane = 1; lane < dotProductLanes; ++lane)
+                {
+                    PrintFormated(stream, " + sums[%][%]", j, lane);
+                }
+                stream << ";\n";
+            }
+        }
+        else
+        {
+            // each column of A is read once, scaled by the elements of a row of B and added to the columns of C (AXPY)
+            PrintFormated(stream, "for(int k = 0; k < %; ++k)    // %x%x% matrix-vector kernel, AXPY along the columns of A\n", k, m, k, n);
+            stream << Indent << "{\n";
+            IncreaseIndent();
+            stream << Indent;
+            PrintFormated(stream, "const float* a = % + k * %;\n", A, GetColumnStride(a));
+            for(int j = 0; j < n; ++j)
+            {
+                stream << Indent;
+                PrintFormated(stream, "const float x% = %[k * % + %];\n", j, B, GetRowStride(b), j * GetColumnStride(b));
+            }
+            stream << Indent;
+            PrintFormated(stream, "for(int i = 0; i < %; ++i)\n", m);
+            stream << Indent << "{\n";
+            IncreaseIndent();
+            for(int j = 0; j < n; ++j)
+            {
+                stream << Indent;
+                PrintFormated(stream, "%[i * % + %] += a[i] * x%;\n", C, GetRowStride(c), j * GetColumnStride(c), j);
+            }
+            DecreaseIndent();
+            stream << Indent << "}\n";
+        }
+        DecreaseIndent();
+        stream << Indent << "}\n";
+    }
+
+    // kernels that can be referenced by name, for example in serialized schedules
+    using KernelFunction = void(*)(std::ostream&, const MatrixStatement&, const MatrixStatement&, const MatrixStatement&);
+
+    struct RegisteredKernel
+    {
+        const char* name;
+        KernelFunction function;
+    };
+
+    const RegisteredKernel registeredKernels[] = 
+    {
+        {"MMKernel222", MMKernel222},
+        {"MVKernel", MVKernel}
+    };
+
+    std::string GetKernelName(const KernelStatement::KernelType& kernel)
+    {
+        auto function = kernel.target<KernelFunction>();
+        if(function != nullptr)
+        {
+            for(const auto& registeredKernel : registeredKernels)
+            {
+                if(registeredKernel.function == *function)
+                {
+                    return registeredKernel.name;
+                }
+            }
+        }
+
+        throw std::logic_error("kernel is not registered");
+    }
+
+    KernelStatement::KernelType GetKernelByName(const std::string& name)
+    {
+        for(const auto& registeredKernel : registeredKernels)
+        {
+            if(registeredKernel.name == name)
+            {
+                return registeredKernel.function;
+            }
+        }
+
+        throw std::logic_error("unknown kernel " + name);
+    }
 }
\ No newline at end of file
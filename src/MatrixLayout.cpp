@@ -8,51 +8,49 @@
 
 #include "MatrixLayout.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <stdexcept>
 
 namespace  tiler
 {
-    MatrixLayout::MatrixLayout(int numRows, int numColumns, MatrixOrder order, int leadingDimensionSize) : _numRows(numRows), _numColumns(numColumns), _order(order), _leadingDimensionSize(leadingDimensionSize)
-    {}
-
-    MatrixLayout::MatrixLayout(int numRows, int numColumns, MatrixOrder order) : _numRows(numRows), _numColumns(numColumns), _order(order), _leadingDimensionSize((order == MatrixOrder::rowMajor) ? numColumns : numRows)
-    {}
-
-    int MatrixLayout::Size() const 
-    { 
-        return _numRows * _numColumns; 
-    }
-    
-    int MatrixLayout::GetMajorSize() const 
-    { 
-        return (_order == MatrixOrder::rowMajor) ? _numRows : _numColumns; 
-    }
-    
-    int MatrixLayout::GetMinorSize() const 
-    { 
-        return (_order == MatrixOrder::columnMajor) ? _numRows : _numColumns; 
-    }
-
-    int MatrixLayout::operator()(int row, int column) const
+    std::string GetOrderName(MatrixOrder order)
     {
-        if(_order == MatrixOrder::rowMajor)
+        switch(order)
         {
-            return row * _leadingDimensionSize + column;
+            case MatrixOrder::rowMajor: return "row";
+            case MatrixOrder::columnMajor: return "column";
+            case MatrixOrder::blocked: return "blocked";
+            default: return "morton";
         }
-        else
+    }
+
+    MatrixOrder GetOrderByName(const std::string& name)
+    {
+        for(auto order : { MatrixOrder::rowMajor, MatrixOrder::columnMajor, MatrixOrder::blocked, MatrixOrder::morton })
         {
-            return row + column * _leadingDimensionSize;
+            if(GetOrderName(order) == name)
+            {
+                return order;
+            }
         }
+
+        throw std::logic_error("unknown matrix order " + name);
     }
 
     std::vector<float> MatrixToVector(MatrixOrder order, std::initializer_list<std::initializer_list<float>> list)
+    {
+        return MatrixToVector(order, 1, list);
+    }
+
+    std::vector<float> MatrixToVector(MatrixOrder order, int blockSize, std::initializer_list<std::initializer_list<float>> list)
     {
         int numRows = (int)list.size();
         int numColumns = (int)(list.begin()->size());
 
-        std::vector<float> v(numRows * numColumns);
-        MatrixLayout matrixLayout(numRows, numColumns, order);
+        int leadingDimensionSize = (order == MatrixOrder::columnMajor) ? numRows : (numColumns + blockSize - 1) / blockSize * blockSize;
+        MatrixLayout matrixLayout(numRows, numColumns, order, leadingDimensionSize, blockSize);
+        std::vector<float> v(matrixLayout.Size());
 
         int i = 0;
         for (auto rowIter = list.begin(); rowIter < list.end(); ++rowIter)
@@ -74,4 +72,87 @@ namespace  tiler
 
         return v;
     }
-} 
\ No newline at end of file
+
+    void ConvertLayout(const float* source, const MatrixLayout& sourceLayout, float* target, const MatrixLayout& targetLayout)
+    {
+        if(sourceLayout.NumRows() != targetLayout.NumRows() || sourceLayout.NumColumns() != targetLayout.NumColumns())
+        {
+            throw std::logic_error("layout conversion requires matrices of the same size");
+        }
+
+        for(int i = 0; i < sourceLayout.NumRows(); ++i)
+        {
+            for(int j = 0; j < sourceLayout.NumColumns(); ++j)
+            {
+                target[targetLayout(i, j)] = source[sourceLayout(i, j)];
+            }
+        }
+    }
+
+    // the cache model of the conflict analysis: 64-byte lines, sets that repeat every 4KB (which is also the distance of 4K aliasing), 8 ways
+    const int cacheLineSize = 64;
+    const int cacheWaySize = 4096;
+    const int cacheAssociativity = 8;
+
+    bool IsConflictProneStride(int strideSize, int count)
+    {
+        // rows that are narrower than a line share lines (a vector is walked sequentially)
+        long strideBytes = strideSize * (long)sizeof(float);
+        if(strideBytes < cacheLineSize)
+        {
+            return false;
+        }
+
+        if(count > 1 && strideBytes % cacheWaySize == 0)
+        {
+            return true;
+        }
+
+        // the walk is capped at the number of rows that fit in half of the cache, which is all that needs to stay resident
+        const int numSets = cacheWaySize / cacheLineSize;
+        count = std::min(count, numSets * cacheAssociativity / 2);
+
+        std::vector<int> rowsPerSet(numSets);
+        for(int i = 0; i < count; ++i)
+        {
+            int set = (i * strideBytes / cacheLineSize) % numSets;
+            if(++rowsPerSet[set] > cacheAssociativity / 2)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool IsConflictProne(const MatrixLayout& layout)
+    {
+        return !layout.IsBlocked() && IsConflictProneStride(layout.GetLeadingDimensionSize(), layout.GetMajorSize());
+    }
+
+    int GetPaddedLeadingDimensionSize(int leadingDimensionSize, int numMajor)
+    {
+        if(!IsConflictProneStride(leadingDimensionSize, numMajor))
+        {
+            return leadingDimensionSize;
+        }
+
+        // whole cache lines keep the rows aligned, and an odd number of lines visits every set
+        const int lineSize = cacheLineSize / sizeof(float);
+        int paddedSize = (leadingDimensionSize + lineSize - 1) / lineSize * lineSize;
+        while(IsConflictProneStride(paddedSize, numMajor))
+        {
+            paddedSize += lineSize;
+        }
+        return paddedSize;
+    }
+
+    MatrixLayout GetPaddedLayout(const MatrixLayout& layout)
+    {
+        if(layout.IsBlocked())
+        {
+            return layout;
+        }
+
+        return MatrixLayout(layout.NumRows(), layout.NumColumns(), layout.GetOrder(), GetPaddedLeadingDimensionSize(layout.GetLeadingDimensionSize(), layout.GetMajorSize()));
+    }
+}
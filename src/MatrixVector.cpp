@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     MatrixVector.cpp
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MatrixVector.h"
+#include "Kernel.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace tiler
+{
+    void AppendMatrixVectorSchedule(NestStatementAppender nest, const Variable& matrixA, const Variable& matrixB, const Variable& matrixC, int panelSize, bool parallel)
+    {
+        auto a = nest.GetNest()->FindStatementByTypeAndVariable<MatrixStatement>(matrixA)->GetLayout();
+        auto c = nest.GetNest()->FindStatementByTypeAndVariable<MatrixStatement>(matrixC)->GetLayout();
+        if(panelSize < 1)
+        {
+            throw std::logic_error("panel size of a matrix-vector schedule must be positive");
+        }
+
+        int m = a.NumRows();
+        int n = c.NumColumns();
+        int k = a.NumColumns();
+        int panel = std::min(panelSize, m);
+        int numPanelRows = m / panel * panel;
+
+        // the loops over K and N have a single iteration, they only index the tiles
+        Variable i, j, l;
+        Variable AA, BB, CC;
+        auto panelLoop = nest.ForAll(i, 0, numPanelRows, panel);
+        if(parallel)
+        {
+            panelLoop.Parallel();
+        }
+
+        nest.ForAll(j, 0, n, n)
+            .ForAll(l, 0, k, k)
+            .Tile(AA, matrixA, i, l, panel, k);
+        nest.Tile(BB, matrixB, l, j, k, n);
+        nest.Tile(CC, matrixC, i, j, panel, n);
+        nest.Kernel(AA, BB, CC, MVKernel);
+
+        // the rows that don't fill a panel are a single smaller panel, in a loop that follows the panel loop
+        if(numPanelRows < m)
+        {
+            int remainder = m - numPanelRows;
+            Variable ri, rj, rl;
+            Variable RA, RB, RC;
+            nest.ForAll(ri, numPanelRows, m, remainder).Follows(i);
+            nest.ForAll(rj, 0, n, n)
+                .ForAll(rl, 0, k, k)
+                .Tile(RA, matrixA, ri, rl, remainder, k);
+            nest.Tile(RB, matrixB, rl, rj, k, n);
+            nest.Tile(RC, matrixC, ri, rj, remainder, n);
+            nest.Kernel(RA, RB, RC, MVKernel);
+        }
+    }
+}
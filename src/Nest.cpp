@@ -10,11 +10,16 @@
 #include "PrintUtils.h"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
 
 namespace tiler
 {
     const char* copyFunction = 
-    R"AW(    void Copy(float* target, const float* source, int size, int count, int targetSkip, int sourceSkip)
+    R"AW(#include <algorithm>
+
+    void Copy(float* __restrict__ target, const float* __restrict__ source, int size, int count, int targetSkip, int sourceSkip)
     {
         for(int i=0; i<count; ++i)
         {
@@ -26,24 +31,487 @@ namespace tiler
     )AW";
 
     const char* copyTransposeFunction = 
-    R"AW(    void CopyTranspose(float* target, const float* source, int size, int count, int targetSkip, int sourceSkip)
+    R"AW(    void CopyTranspose(float* __restrict__ target, const float* __restrict__ source, int size, int count, int targetSkip, int sourceSkip)
     {
         for(int i=0; i<count; ++i)
         {
             for(int j=0; j<size; ++j)
             {
-                target[i * sourceSkip + j] = source[i + j * targetSkip];
+                target[i * targetSkip + j] = source[i + j * sourceSkip];
             }
         }
     }
     )AW";
 
+    const char* copyIndexedFunction = 
+    R"AW(    void CopyIndexed(float* __restrict__ target, const float* __restrict__ source, const int* targetOffsets, const int* sourceOffsets, int count)
+    {
+        for(int i=0; i<count; ++i)
+        {
+            target[targetOffsets[i]] = source[sourceOffsets[i]];
+        }
+    }
+    )AW";
+
+    const char* mortonIndexFunction = 
+    R"AW(    int MortonIndex(int row, int column)
+    {
+        int index = 0;
+        for(int bit = 0; (row >> bit) != 0 || (column >> bit) != 0; ++bit)
+        {
+            index |= ((column >> bit) & 1) << (2 * bit);
+            index |= ((row >> bit) & 1) << (2 * bit + 1);
+        }
+        return index;
+    }
+    )AW";
+
+    const char* combinationFunctions = 
+    R"AW(#include <algorithm>
+
+    void CopyCombination(float* __restrict__ target, const float* source, const int* offsets, const float* coefficients, int numTerms, int size, int count, int targetSkip, int sourceSkip, int sourceStep)
+    {
+        for(int i=0; i<count; ++i)
+        {
+            float* targetRow = target + i * targetSkip;
+            const float* sourceRow = source + offsets[0] + i * sourceSkip;
+            for(int j=0; j<size; ++j)
+            {
+                targetRow[j] = coefficients[0] * sourceRow[j * sourceStep];
+            }
+
+            for(int t=1; t<numTerms; ++t)
+            {
+                sourceRow = source + offsets[t] + i * sourceSkip;
+                for(int j=0; j<size; ++j)
+                {
+                    targetRow[j] += coefficients[t] * sourceRow[j * sourceStep];
+                }
+            }
+        }
+    }
+
+    void AddCombination(float* target, const float* __restrict__ source, const int* offsets, const float* coefficients, int numTerms, int size, int count, int targetSkip, int targetStep, int sourceSkip)
+    {
+        for(int t=0; t<numTerms; ++t)
+        {
+            for(int i=0; i<count; ++i)
+            {
+                float* targetRow = target + offsets[t] + i * targetSkip;
+                const float* sourceRow = source + i * sourceSkip;
+                for(int j=0; j<size; ++j)
+                {
+                    targetRow[j * targetStep] += coefficients[t] * sourceRow[j];
+                }
+            }
+        }
+    }
+    )AW";
+
+    const char* parallelFunctions = 
+    R"AW(#include <algorithm>
+    #include <atomic>
+    #include <cstdio>
+    #include <cstdlib>
+    #include <fstream>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <string>
+    #include <thread>
+    #include <utility>
+    #include <vector>
+
+    thread_local int parallelNode = 0;
+    thread_local int parallelThread = 0;
+    thread_local int parallelNumThreads = 1;
+
+    // The barrier of the threads of a parallel loop, the waiting threads yield until the last one arrives
+    struct TeamBarrier
+    {
+        std::atomic<int> count{0};
+        std::atomic<int> generation{0};
+        int size = 1;
+    };
+    TeamBarrier parallelBarrier;
+
+    void ParallelBarrier()
+    {
+        int generation = parallelBarrier.generation.load();
+        if(parallelBarrier.count.fetch_add(1) + 1 == parallelBarrier.size)
+        {
+            parallelBarrier.count.store(0);
+            parallelBarrier.generation.fetch_add(1);
+            return;
+        }
+
+        while(parallelBarrier.generation.load() == generation)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // Returns the CPUs of each NUMA node that this process may run on, TILER_NUMA_NODES=n simulates n nodes by splitting the CPUs
+    // (nodes share CPUs when there are fewer CPUs than nodes)
+    const std::vector<std::vector<int>>& GetNumaNodes()
+    {
+        static std::vector<std::vector<int>> nodes;
+        if(!nodes.empty())
+        {
+            return nodes;
+        }
+
+        std::vector<int> cpus;
+        cpu_set_t affinity;
+        if(sched_getaffinity(0, sizeof(affinity), &affinity) == 0)
+        {
+            for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if(CPU_ISSET(cpu, &affinity))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        if(cpus.empty())
+        {
+            cpus.push_back(0);
+        }
+
+        const char* simulatedNodes = getenv("TILER_NUMA_NODES");
+        if(simulatedNodes != nullptr && atoi(simulatedNodes) > 0)
+        {
+            int numNodes = atoi(simulatedNodes);
+            for(int node = 0; node < numNodes; ++node)
+            {
+                nodes.emplace_back(cpus.begin() + cpus.size() * node / numNodes, cpus.begin() + cpus.size() * (node + 1) / numNodes);
+                if(nodes.back().empty())
+                {
+                    nodes.back().push_back(cpus[cpus.size() * node / numNodes]);
+                }
+            }
+            return nodes;
+        }
+
+        for(int node = 0; ; ++node)
+        {
+            std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if(!cpuList)
+            {
+                break;
+            }
+
+            // the list has the form 0-3,8-11
+            std::vector<int> nodeCpus;
+            std::string range;
+            while(std::getline(cpuList, range, ','))
+            {
+                int first = 0;
+                int last = 0;
+                int numFields = sscanf(range.c_str(), "%d-%d", &first, &last);
+                if(numFields == 1)
+                {
+                    last = first;
+                }
+                for(int cpu = first; numFields > 0 && cpu <= last; ++cpu)
+                {
+                    if(std::find(cpus.begin(), cpus.end(), cpu) != cpus.end())
+                    {
+                        nodeCpus.push_back(cpu);
+                    }
+                }
+            }
+
+            if(!nodeCpus.empty())
+            {
+                nodes.push_back(nodeCpus);
+            }
+        }
+
+        if(nodes.empty())
+        {
+            nodes.push_back(cpus);
+        }
+        return nodes;
+    }
+
+    void PinThread(int cpu)
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    }
+
+    // Returns the (node, CPU) pairs of all the CPUs, in node order
+    const std::vector<std::pair<int, int>>& GetParallelCpus()
+    {
+        static std::vector<std::pair<int, int>> cpus;
+        if(cpus.empty())
+        {
+            const auto& nodes = GetNumaNodes();
+            for(int node = 0; node < (int)nodes.size(); ++node)
+            {
+                for(int cpu : nodes[node])
+                {
+                    cpus.emplace_back(node, cpu);
+                }
+            }
+        }
+        return cpus;
+    }
+
+    // Returns the number of threads that run a parallel loop, at most one per CPU. In lockstep, the number of threads divides the
+    // number of iterations, so every thread runs the same number of iterations and reaches the same barriers
+    int ParallelTeamSize(int numIterations, int maxThreads, bool lockstep)
+    {
+        int numThreads = std::min({(int)GetParallelCpus().size(), numIterations, maxThreads});
+        while(lockstep && numThreads > 1 && numIterations % numThreads != 0)
+        {
+            --numThreads;
+        }
+        return numThreads;
+    }
+
+    // Runs the iterations on pinned threads, each with a contiguous range of iterations. The threads are spread evenly over
+    // the CPUs of all nodes, so each node gets iterations in proportion to its CPUs
+    template <typename BodyType>
+    void ParallelFor(int start, int stop, int step, int numThreads, BodyType body)
+    {
+        const auto& cpus = GetParallelCpus();
+        int numIterations = std::max((stop - start + step - 1) / step, 0);
+        parallelBarrier.size = numThreads;
+
+        std::vector<std::thread> threads;
+        for(int thread = 0; thread < numThreads; ++thread)
+        {
+            auto cpu = cpus[(long)cpus.size() * thread / numThreads];
+            int first = (int)((long)numIterations * thread / numThreads);
+            int last = (int)((long)numIterations * (thread + 1) / numThreads);
+            threads.emplace_back([=, &body]()
+            {
+                PinThread(cpu.second);
+                parallelNode = cpu.first;
+                parallelThread = thread;
+                parallelNumThreads = numThreads;
+                for(int i = first; i < last; ++i)
+                {
+                    body(start + i * step);
+                }
+            });
+        }
+
+        for(auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Copies a matrix to each node, each copy is first touched by a thread of its node
+    std::vector<float*> ReplicatePerNode(const float* matrix, long size)
+    {
+        const auto& nodes = GetNumaNodes();
+        std::vector<float*> replicas(nodes.size());
+        std::vector<std::thread> threads;
+        for(int node = 0; node < (int)nodes.size(); ++node)
+        {
+            threads.emplace_back([&, node]()
+            {
+                PinThread(nodes[node][0]);
+                replicas[node] = (float*)aligned_alloc(64, (size * sizeof(float) + 63) / 64 * 64);
+                std::copy_n(matrix, size, replicas[node]);
+            });
+        }
+
+        for(auto& thread : threads)
+        {
+            thread.join();
+        }
+        return replicas;
+    }
+
+    void FreeReplicas(std::vector<float*>& replicas)
+    {
+        for(auto replica : replicas)
+        {
+            free(replica);
+        }
+    }
+
+    // Allocates a zeroed partial copy of a split output for each thread
+    std::vector<float*> AllocatePartials(long size, int numThreads)
+    {
+        std::vector<float*> partials(numThreads);
+        for(auto& partial : partials)
+        {
+            partial = (float*)aligned_alloc(64, (size * sizeof(float) + 63) / 64 * 64);
+            std::fill_n(partial, size, 0.0f);
+        }
+        return partials;
+    }
+
+    // Adds the partial copies of a split output to the output and frees them. The partials are summed in pairs, level by level, on
+    // the CPUs of the threads that wrote them, so the reduction takes log(numThreads) passes over the output
+    void ReducePartials(float* output, std::vector<float*>& partials, long size)
+    {
+        const auto& cpus = GetParallelCpus();
+        int numPartials = (int)partials.size();
+        for(int stride = 1; stride < numPartials; stride *= 2)
+        {
+            std::vector<std::thread> threads;
+            for(int index = 0; index + stride < numPartials; index += 2 * stride)
+            {
+                threads.emplace_back([=, &partials]()
+                {
+                    PinThread(cpus[(long)cpus.size() * index / numPartials].second);
+                    float* __restrict__ target = partials[index];
+                    const float* __restrict__ source = partials[index + stride];
+                    for(long i = 0; i < size; ++i)
+                    {
+                        target[i] += source[i];
+                    }
+                });
+            }
+
+            for(auto& thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        for(long i = 0; i < size && numPartials > 0; ++i)
+        {
+            output[i] += partials[0][i];
+        }
+        FreeReplicas(partials);
+    }
+    )AW";
+
+    const char* mapMatrixFunction = 
+    R"AW(#include <algorithm>
+    #include <fcntl.h>
+    #include <stdio.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+
+    // Returns nullptr, after printing the reason, if the file can't be mapped or a read-only file is too short
+    float* MapMatrix(const char* path, long size, bool writable)
+    {
+        long bytes = size * sizeof(float);
+        int file = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+        struct stat status;
+        if(file < 0 || fstat(file, &status) != 0)
+        {
+            perror(path);
+            if(file >= 0)
+            {
+                close(file);
+            }
+            return nullptr;
+        }
+
+        if(status.st_size < bytes)
+        {
+            // reading past the end of a mapped file raises SIGBUS, so only a writable file is extended
+            if(!writable)
+            {
+                fprintf(stderr, "%s: file has %ld bytes, the matrix requires %ld\n", path, (long)status.st_size, bytes);
+                close(file);
+                return nullptr;
+            }
+
+            if(ftruncate(file, bytes) != 0)
+            {
+                perror(path);
+                close(file);
+                return nullptr;
+            }
+        }
+
+        void* data = mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+        close(file);
+        if(data == MAP_FAILED)
+        {
+            perror(path);
+            return nullptr;
+        }
+
+        madvise(data, bytes, MADV_SEQUENTIAL);
+        return (float*)data;
+    }
+
+    void AdviseWillNeed(const float* matrix, long size, long offset, long count)
+    {
+        if(offset >= size)
+        {
+            return;
+        }
+
+        long pageSize = sysconf(_SC_PAGESIZE);
+        char* begin = (char*)(matrix + offset);
+        char* end = (char*)(matrix + std::min(size, offset + count));
+        char* alignedBegin = (char*)((long)begin & ~(pageSize - 1));
+        madvise(alignedBegin, end - alignedBegin, MADV_WILLNEED);
+    }
+
+    void UnmapMatrix(float* data, long size)
+    {
+        munmap(data, size * sizeof(float));
+    }
+    )AW";
+
     template<typename IsType, typename OrigType>
     bool IsPointerTo(const OrigType& pointer)
     {
         return (std::dynamic_pointer_cast<IsType>(pointer) != nullptr);
     }
 
+    int GetTieBreakRank(const Nest::StatementPtr& statement)
+    {
+        if(IsPointerTo<ForAllStatement>(statement))
+        {
+            return 0;
+        }
+
+        if(IsPointerTo<KernelStatement>(statement))
+        {
+            return 2;
+        }
+
+        return 1;
+    }
+
+    void CheckDependenciesAreOpen(const Nest::StatementPtr& statement, const std::vector<Nest::StatementPtr>& openStatements)
+    {
+        std::vector<Nest::StatementPtr> dependencies;
+
+        auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement);
+        if(tileStatement != nullptr)
+        {
+            dependencies = { tileStatement->GetTopStatement(), tileStatement->GetLeftStatement() };
+        }
+
+        auto kernelStatement = std::dynamic_pointer_cast<KernelStatement>(statement);
+        if(kernelStatement != nullptr)
+        {
+            dependencies = { kernelStatement->GetMatrixAStatement(), kernelStatement->GetMatrixBStatement(), kernelStatement->GetMatrixCStatement() };
+        }
+
+        auto blockLoop = std::dynamic_pointer_cast<BlockForAllStatement>(statement);
+        if(blockLoop != nullptr)
+        {
+            dependencies = { blockLoop->GetRowStatement() };
+        }
+
+        for(const auto& dependency : dependencies)
+        {
+            if(std::find(openStatements.begin(), openStatements.end(), dependency) == openStatements.end())
+            {
+                throw std::logic_error("statement " + statement->GetVariable().GetName() + " depends on " + dependency->GetVariable().GetName() + ", which is not in scope");
+            }
+        }
+    }
+
     void Nest::AddStatement(Nest::StatementPtr nestStatement)
     {
         _statements.push_back(nestStatement);
@@ -54,19 +522,83 @@ namespace tiler
         return (int)_statements.size(); 
     }
 
-    void Nest::Print(std::ostream& stream)
+    void Nest::Print(std::ostream& stream, Instrumentation instrumentation)
     {
         IncreaseIndent();
+        PrintFunctions(stream, _statements);
+
+        StatementProfiler profiler(instrumentation, _statements);
+        profiler.PrintFunctions(stream);
+
+        // start main function
+        stream << Indent << "int main()\n" << Indent << "{\n";
+        IncreaseIndent();
+        profiler.PrintStart(stream);
+        PrintBody(stream, profiler);
+        profiler.PrintReport(stream);
 
+        //print prefix
+        DecreaseIndent();
+        stream << Indent << "}";
+    }
+
+    void Nest::PrintFunctions(std::ostream& stream, const std::vector<StatementPtr>& statements)
+    {
         // pre-sort pass 1 - identify required functions
         bool requiresCopy = false;
         bool requiresCopyTranspose = false;
-        for(const auto& statement : _statements)
+        bool requiresCopyIndexed = false;
+        bool requiresMortonIndex = false;
+        bool requiresMapMatrix = false;
+        bool requiresCombination = false;
+        bool requiresParallel = false;
+        bool requiresAlgorithm = false;
+        for(const auto& statement : statements)
         {
+            auto loopStatement = std::dynamic_pointer_cast<ForAllStatement>(statement);
+            if(loopStatement != nullptr && loopStatement->IsParallel())
+            {
+                requiresParallel = true;
+            }
+
+            if(IsPointerTo<MappedUsingStatement>(statement))
+            {
+                requiresMapMatrix = true;
+            }
+
+            // scratch tiles are cleared with std::fill_n
+            if(IsPointerTo<ScratchStatement>(statement))
+            {
+                requiresAlgorithm = true;
+            }
+
+            auto combinationStatement = std::dynamic_pointer_cast<CombinationUsingStatement>(statement);
+            if(combinationStatement != nullptr && !combinationStatement->IsView())
+            {
+                requiresCombination = true;
+            }
+
+            auto recursiveStatement = std::dynamic_pointer_cast<RecursiveKernelStatement>(statement);
+            if(recursiveStatement != nullptr)
+            {
+                requiresCopy = requiresCopy || recursiveStatement->RequiresCopy();
+                requiresCopyTranspose = requiresCopyTranspose || recursiveStatement->RequiresCopyTranspose();
+            }
+
             auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement);
             if(tileStatement != nullptr)
             {
-                if(tileStatement->IsCached())
+                if(tileStatement->GetMatrixStatement()->GetLayout().GetOrder() == MatrixOrder::morton)
+                {
+                    requiresMortonIndex = true;
+                }
+
+                auto matrixCombination = std::dynamic_pointer_cast<CombinationUsingStatement>(tileStatement->GetMatrixStatement());
+                if(tileStatement->RequiresIndexedCopy())
+                {
+                    requiresCopyIndexed = true;
+                }
+                else if(tileStatement->IsCached() && (matrixCombination == nullptr || !matrixCombination->IsFused()))
                 {
                     if(tileStatement->IsTransposed())
                     {
@@ -80,6 +612,10 @@ namespace tiler
             }
         }
 
+        if(requiresAlgorithm)
+        {
+            stream << "#include <algorithm>" << std::endl;
+        }
         if(requiresCopy)
         {
             stream << copyFunction << std::endl;
@@ -88,12 +624,49 @@ namespace tiler
         {
             stream << copyTransposeFunction << std::endl;
         }
+        if(requiresCopyIndexed)
+        {
+            stream << copyIndexedFunction << std::endl;
+        }
+        if(requiresMortonIndex)
+        {
+            stream << mortonIndexFunction << std::endl;
+        }
+        if(requiresMapMatrix)
+        {
+            stream << mapMatrixFunction << std::endl;
+        }
+        if(requiresCombination)
+        {
+            stream << combinationFunctions << std::endl;
+        }
+        if(requiresParallel)
+        {
+            stream << parallelFunctions << std::endl;
+        }
 
-        // start main function
-        stream << Indent << "int main()\n" << Indent << "{\n";
-        IncreaseIndent();
+        // print the offset tables of indexed cache copies and the functions of recursive kernels
+        for(const auto& statement : statements)
+        {
+            auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement);
+            if(tileStatement != nullptr && tileStatement->RequiresIndexedCopy())
+            {
+                tileStatement->PrintOffsetTables(stream);
+            }
+
+            auto recursiveStatement = std::dynamic_pointer_cast<RecursiveKernelStatement>(statement);
+            if(recursiveStatement != nullptr)
+            {
+                recursiveStatement->PrintFunctions(stream);
+            }
+        }
+    }
 
-        // pre-sort pass 2 - set positions of tile statement
+    std::vector<Nest::StatementPtr> Nest::GetOrderedStatements()
+    {
+        SchedulePanelStreaming();
+
+        // pre-sort pass 2 - set positions of tile and scratch statements
         for(const auto& statement : _statements)
         {
             auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement);
@@ -101,6 +674,31 @@ namespace tiler
             {
                 tileStatement->SetPositionByDependencies();
             }
+
+            auto scratchStatement = std::dynamic_pointer_cast<ScratchStatement>(statement);
+            if(scratchStatement != nullptr)
+            {
+                scratchStatement->SetPositionByDependencies();
+            }
+        }
+
+        // pre-sort pass 3 - each kernel is positioned innermost with respect to the statements defined before it
+        double innermostPosition = 0;
+        for(const auto& statement : _statements)
+        {
+            if(IsPointerTo<UsingStatement>(statement))
+            {
+                continue;
+            }
+
+            if(IsPointerTo<KernelStatement>(statement))
+            {
+                statement->SetPosition(innermostPosition);
+            }
+            else
+            {
+                innermostPosition = std::max(innermostPosition, statement->GetPosition());
+            }
         }
 
         // sort the statements by position
@@ -117,49 +715,400 @@ namespace tiler
                 return false;
             }
 
-            // ties are broken such that tile statements are last
+            // ties are broken such that loops are first and kernels are last
             if (a->GetPosition() == b->GetPosition())
             {
-                if(IsPointerTo<ForAllStatement>(a) && IsPointerTo<TileStatement>(b))
+                return GetTieBreakRank(a) < GetTieBreakRank(b);
+            }
+
+            return a->GetPosition() < b->GetPosition();
+        };
+        auto statements = _statements;
+        std::stable_sort(statements.begin(), statements.end(), comparer);
+        PrepareParallelLoop(statements);
+        ReduceAddressArithmetic(statements);
+        return statements;
+    }
+
+    void Nest::Traverse(const std::vector<StatementPtr>& orderedStatements, const StatementVisitor& enter, const StatementVisitor& exit)
+    {
+        // forward pass, which closes the predecessor of a sibling loop before opening it
+        std::vector<StatementPtr> openStatements;
+        for(const auto& statement : orderedStatements)
+        {
+            auto loopStatement = std::dynamic_pointer_cast<ForAllStatement>(statement);
+            if(loopStatement != nullptr && loopStatement->GetPredecessor() != nullptr)
+            {
+                auto predecessor = loopStatement->GetPredecessor();
+                if(std::find(openStatements.begin(), openStatements.end(), predecessor) == openStatements.end())
                 {
-                    return true;
+                    throw std::logic_error("loop " + loopStatement->GetVariable().GetName() + " follows loop " + predecessor->GetVariable().GetName() + ", which does not enclose it");
                 }
 
-                if(IsPointerTo<ForAllStatement>(b) && IsPointerTo<TileStatement>(a))
+                StatementPtr closedStatement;
+                do
                 {
-                    return false;
+                    closedStatement = openStatements.back();
+                    openStatements.pop_back();
+                    exit(closedStatement);
                 }
+                while(closedStatement != predecessor);
             }
 
-            return a->GetPosition() < b->GetPosition();
-        };
-        std::sort(_statements.begin(), _statements.end(), comparer);
+            CheckDependenciesAreOpen(statement, openStatements);
+            enter(statement);
+            openStatements.push_back(statement);
+        }
 
-        // post-sort forward pass
+        // backwards pass
+        std::reverse(openStatements.begin(), openStatements.end());
+        for(const auto& statement : openStatements)
+        {
+            exit(statement);
+        }
+    }
+
+    void Nest::PrintBody(std::ostream& stream, const StatementProfiler& profiler)
+    {
+        Traverse(GetOrderedStatements(), [&](const StatementPtr& statement) { profiler.PrintForward(stream, statement); }, [&](const StatementPtr& statement) { profiler.PrintBackward(stream, statement); });
+    }
+
+    void Nest::SchedulePanelStreaming()
+    {
+        // find the largest mapped matrix and the loops that step through the panels of each mapped matrix
+        std::shared_ptr<ForAllStatement> largestPanelLoop;
+        int largestSize = 0;
         for(const auto& statement : _statements)
         {
-            statement->PrintForward(stream);
+            auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement);
+            if(tileStatement == nullptr)
+            {
+                continue;
+            }
+
+            auto matrixStatement = std::dynamic_pointer_cast<MappedUsingStatement>(tileStatement->GetMatrixStatement());
+            if(matrixStatement == nullptr)
+            {
+                continue;
+            }
+
+            // panels are contiguous along the major dimension of the matrix (morton layouts have no contiguous panels)
+            auto matrixLayout = matrixStatement->GetLayout();
+            if(matrixLayout.GetOrder() == MatrixOrder::morton)
+            {
+                continue;
+            }
+
+            auto panelStatement = (matrixLayout.GetOrder() == MatrixOrder::columnMajor) ? tileStatement->GetLeftStatement() : tileStatement->GetTopStatement();
+            auto panelLoop = std::dynamic_pointer_cast<ForAllStatement>(panelStatement);
+            if(panelLoop == nullptr)
+            {
+                continue;
+            }
+
+            panelLoop->AddPanelPrefetch(matrixStatement->GetVariable().GetName(), matrixLayout.GetDataSize(), matrixLayout.GetLeadingDimensionSize());
+
+            if(matrixLayout.GetDataSize() > largestSize)
+            {
+                largestSize = matrixLayout.GetDataSize();
+                largestPanelLoop = panelLoop;
+            }
         }
 
-        // backwards pass
-        std::reverse(_statements.begin(), _statements.end());
+        if(largestPanelLoop == nullptr)
+        {
+            return;
+        }
+
+        // a loop positioned by the user stays where the user put it
+        if(largestPanelLoop->IsPositioned())
+        {
+            return;
+        }
+
+        // move the panel loop of the largest mapped matrix outermost, so that each of its panels is streamed from disk once. It
+        // doesn't cross a loop positioned by the user, so it only moves outside the loops after the last such loop before it
+        double panelPosition = largestPanelLoop->GetPosition();
+        double floorPosition = -std::numeric_limits<double>::infinity();
         for(const auto& statement : _statements)
         {
-            statement->PrintBackward(stream);
+            auto loopStatement = std::dynamic_pointer_cast<ForAllStatement>(statement);
+            if(loopStatement != nullptr && loopStatement->IsPositioned() && loopStatement->GetPosition() < panelPosition)
+            {
+                floorPosition = std::max(floorPosition, loopStatement->GetPosition());
+            }
         }
 
-        //print prefix
-        DecreaseIndent();
-        stream << Indent << "}";
+        double outermostPosition = std::numeric_limits<double>::infinity();
+        for(const auto& statement : _statements)
+        {
+            if(IsPointerTo<ForAllStatement>(statement) && statement != largestPanelLoop && statement->GetPosition() > floorPosition)
+            {
+                outermostPosition = std::min(outermostPosition, statement->GetPosition());
+            }
+        }
+
+        if(outermostPosition <= panelPosition)
+        {
+            largestPanelLoop->SetPosition(std::isinf(floorPosition) ? outermostPosition - 1 : (floorPosition + outermostPosition) / 2);
+        }
+    }
+
+    void Nest::ReduceAddressArithmetic(const std::vector<StatementPtr>& sortedStatements)
+    {
+        auto getIndex = [&sortedStatements](const StatementPtr& statement) { return std::find(sortedStatements.begin(), sortedStatements.end(), statement) - sortedStatements.begin(); };
+
+        for(const auto& statement : sortedStatements)
+        {
+            // replace the address computation of tiles of linear matrices by a chain of induction pointers, one per loop
+            auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement);
+            if(tileStatement == nullptr)
+            {
+                continue;
+            }
+
+            auto matrixStatement = std::dynamic_pointer_cast<UsingStatement>(tileStatement->GetMatrixStatement());
+            auto topLoop = std::dynamic_pointer_cast<ForAllStatement>(tileStatement->GetTopStatement());
+            auto leftLoop = std::dynamic_pointer_cast<ForAllStatement>(tileStatement->GetLeftStatement());
+            if(matrixStatement == nullptr || matrixStatement->GetLayout().IsBlocked() || topLoop == nullptr || leftLoop == nullptr || topLoop == leftLoop)
+            {
+                continue;
+            }
+
+            // the iterations of a parallel loop don't run in order, so they can't bump a pointer, and a pointer that starts outside a
+            // parallel loop would miss the replica or partial copy that the loop body uses
+            bool isShadowed = std::any_of(sortedStatements.begin(), sortedStatements.end(), [&](const StatementPtr& statement)
+            {
+                auto loopStatement = std::dynamic_pointer_cast<ForAllStatement>(statement);
+                return loopStatement != nullptr && loopStatement->Shadows(matrixStatement->GetVariable().GetName());
+            });
+            if(topLoop->IsParallel() || leftLoop->IsParallel() || isShadowed)
+            {
+                continue;
+            }
+
+            // a BlockForAll loop jumps between nonzero blocks, and blocks are packed
+            if(IsPointerTo<BlockForAllStatement>(topLoop) || IsPointerTo<BlockForAllStatement>(leftLoop) || IsPointerTo<BlockSparseUsingStatement>(matrixStatement))
+            {
+                continue;
+            }
+
+            // the strides of the row and column indices in the matrix
+            auto matrixLayout = matrixStatement->GetLayout();
+            int topStride = matrixLayout(1, 0);
+            int leftStride = matrixLayout(0, 1);
+
+            bool isTopOuter = getIndex(topLoop) < getIndex(leftLoop);
+            auto outerLoop = isTopOuter ? topLoop : leftLoop;
+            auto innerLoop = isTopOuter ? leftLoop : topLoop;
+            int outerStride = isTopOuter ? topStride : leftStride;
+            int innerStride = isTopOuter ? leftStride : topStride;
+
+            // the outer pointer is hoisted out of the inner loop, so the inner loop only bumps its own pointer
+            auto tileName = tileStatement->GetVariable().GetName();
+            auto outerPointer = tileName + "_" + outerLoop->GetVariable().GetName();
+            auto innerPointer = tileName + "_" + innerLoop->GetVariable().GetName();
+            outerLoop->AddInductionPointer(outerPointer, matrixStatement->GetVariable().GetName() + " + " + std::to_string(outerLoop->GetStart() * outerStride), outerLoop->GetStep() * outerStride);
+            innerLoop->AddInductionPointer(innerPointer, outerPointer + " + " + std::to_string(innerLoop->GetStart() * innerStride), innerLoop->GetStep() * innerStride);
+            tileStatement->SetSourcePointer(innerPointer);
+        }
+    }
+
+    // The statements that are nested in a loop, as Traverse opens and closes them
+    using EnclosedStatements = std::set<const StatementBase*>;
+
+    EnclosedStatements GetEnclosedStatements(const std::vector<Nest::StatementPtr>& sortedStatements, const std::shared_ptr<ForAllStatement>& loop)
+    {
+        EnclosedStatements enclosed;
+        bool isOpen = false;
+        Nest::Traverse(sortedStatements, 
+            [&](const Nest::StatementPtr& statement) 
+            { 
+                if(isOpen)
+                {
+                    enclosed.insert(statement.get());
+                }
+                isOpen = isOpen || statement == loop;
+            }, 
+            [&](const Nest::StatementPtr& statement) { isOpen = isOpen && statement != loop; });
+        return enclosed;
+    }
+
+    // Determines if each iteration of a parallel loop writes its own part of a matrix
+    bool IsPrivateTo(const std::shared_ptr<MatrixStatement>& matrixStatement, const std::shared_ptr<ForAllStatement>& loop, const EnclosedStatements& enclosed)
+    {
+        // scratch tiles inside the loop are allocated by each thread
+        if(IsPointerTo<ScratchStatement>(matrixStatement))
+        {
+            return enclosed.count(matrixStatement.get()) > 0;
+        }
+
+        auto tileStatement = std::dynamic_pointer_cast<TileStatement>(matrixStatement);
+        if(tileStatement != nullptr)
+        {
+            return tileStatement->GetTopStatement() == loop || tileStatement->GetLeftStatement() == loop || IsPrivateTo(tileStatement->GetMatrixStatement(), loop, enclosed);
+        }
+
+        return false;
+    }
+
+    void Nest::PrepareParallelLoop(std::vector<StatementPtr>& sortedStatements) const
+    {
+        std::shared_ptr<ForAllStatement> parallelLoop;
+        for(const auto& statement : sortedStatements)
+        {
+            auto loopStatement = std::dynamic_pointer_cast<ForAllStatement>(statement);
+            if(loopStatement != nullptr && loopStatement->IsParallel())
+            {
+                if(parallelLoop != nullptr)
+                {
+                    throw std::logic_error("loops " + parallelLoop->GetVariable().GetName() + " and " + loopStatement->GetVariable().GetName() + " are both parallel");
+                }
+                parallelLoop = loopStatement;
+            }
+        }
+
+        // the statements in the body of the parallel loop, which excludes sibling loops that follow it
+        EnclosedStatements enclosed;
+        if(parallelLoop != nullptr)
+        {
+            enclosed = GetEnclosedStatements(sortedStatements, parallelLoop);
+        }
+
+        // a shared cache is packed by the threads of a parallel loop, so it must be inside the loop and the same for every thread
+        for(const auto& statement : sortedStatements)
+        {
+            auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement);
+            if(tileStatement == nullptr || !tileStatement->IsShared())
+            {
+                continue;
+            }
+
+            auto name = tileStatement->GetVariable().GetName();
+            if(enclosed.count(tileStatement.get()) == 0)
+            {
+                throw std::logic_error("shared cache " + name + " is not inside a parallel loop");
+            }
+            if(IsPrivateTo(tileStatement, parallelLoop, enclosed))
+            {
+                throw std::logic_error("shared cache " + name + " is indexed by parallel loop " + parallelLoop->GetVariable().GetName());
+            }
+
+            auto combination = std::dynamic_pointer_cast<CombinationUsingStatement>(tileStatement->GetMatrixStatement());
+            if(tileStatement->RequiresIndexedCopy() || (combination != nullptr && combination->IsFused()))
+            {
+                throw std::logic_error("shared cache " + name + " requires a strided copy");
+            }
+            parallelLoop->SetLockstep(true);
+        }
+
+        if(parallelLoop == nullptr)
+        {
+            return;
+        }
+
+        // the kernels inside the parallel loop write disjoint parts of their outputs, or else the output is split: the outermost
+        // buffer of the output outside the loop is replaced in the loop body by a partial copy per thread
+        for(const auto& statement : sortedStatements)
+        {
+            auto kernelStatement = std::dynamic_pointer_cast<KernelStatement>(statement);
+            if(kernelStatement == nullptr || enclosed.count(kernelStatement.get()) == 0 || IsPrivateTo(kernelStatement->GetMatrixCStatement(), parallelLoop, enclosed))
+            {
+                continue;
+            }
+
+            auto outputStatement = kernelStatement->GetMatrixCStatement();
+            auto tileStatement = std::dynamic_pointer_cast<TileStatement>(outputStatement);
+            while(tileStatement != nullptr && enclosed.count(tileStatement.get()) > 0)
+            {
+                outputStatement = tileStatement->GetMatrixStatement();
+                tileStatement = std::dynamic_pointer_cast<TileStatement>(outputStatement);
+            }
+
+            auto name = outputStatement->GetVariable().GetName();
+            if(IsPointerTo<CombinationUsingStatement>(outputStatement) || (tileStatement != nullptr && !tileStatement->IsCached()))
+            {
+                throw std::logic_error("parallel loop " + parallelLoop->GetVariable().GetName() + " can't split the output " + name + ", which is not a matrix or a cache");
+            }
+            parallelLoop->AddPartial(name, outputStatement->GetLayout().GetDataSize());
+        }
+
+        // the caches and scratch tiles inside the parallel loop are allocated in its body, so that each thread first touches its own,
+        // except for shared caches, which are allocated once for the team
+        std::vector<StatementPtr> allocations;
+        for(auto iter = sortedStatements.begin(); iter != sortedStatements.end(); )
+        {
+            auto owner = FindStatementByTypeAndVariable((*iter)->GetVariable());
+            auto ownerTile = std::dynamic_pointer_cast<TileStatement>(owner);
+            bool isShared = ownerTile != nullptr && ownerTile->IsShared();
+            if(IsPointerTo<UsingStatement>(*iter) && owner != *iter && enclosed.count(owner.get()) > 0 && !isShared)
+            {
+                allocations.push_back(*iter);
+                iter = sortedStatements.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+
+        auto loopIter = std::find(sortedStatements.begin(), sortedStatements.end(), parallelLoop);
+        sortedStatements.insert(loopIter + 1, allocations.begin(), allocations.end());
     }
 
     NestStatementAppender::NestStatementAppender(std::shared_ptr<Nest> nest) : _nest(nest) 
     {}
 
-    NestStatementAppender NestStatementAppender::Using(Variable matrixVariable, MatrixLayout matrixLayout, bool isOutput, float* data)
+    UsingStatementModifier NestStatementAppender::Using(Variable matrixVariable, MatrixLayout matrixLayout, bool isOutput, float* data)
     {
         auto statement = std::make_shared<UsingStatement>(matrixVariable, matrixLayout, isOutput, data);
         _nest->AddStatement(statement);
+        return UsingStatementModifier(_nest, statement);
+    }
+
+    UsingStatementModifier NestStatementAppender::UsingPadded(Variable matrixVariable, MatrixLayout matrixLayout, float* data)
+    {
+        auto statement = std::make_shared<PaddedUsingStatement>(matrixVariable, matrixLayout, data);
+        _nest->AddStatement(statement);
+        return UsingStatementModifier(_nest, statement);
+    }
+
+    NestStatementAppender NestStatementAppender::UsingMapped(Variable matrixVariable, MatrixLayout matrixLayout, bool isOutput, std::string path)
+    {
+        auto statement = std::make_shared<MappedUsingStatement>(matrixVariable, matrixLayout, isOutput, path);
+        _nest->AddStatement(statement);
+        return *this;
+    }
+
+    NestStatementAppender NestStatementAppender::UsingBlockSparse(Variable matrixVariable, MatrixLayout matrixLayout, int blockRows, int blockColumns, float* data)
+    {
+        auto statement = std::make_shared<BlockSparseUsingStatement>(matrixVariable, matrixLayout, blockRows, blockColumns, data);
+        _nest->AddStatement(statement);
+        return *this;
+    }
+
+    ForAllStatementModifier NestStatementAppender::ForAllBlocks(Variable indexVariable, Variable matrixVariable, Variable rowVariable)
+    {
+        auto matrixStatement = _nest->FindStatementByTypeAndVariable<BlockSparseUsingStatement>(matrixVariable);
+        auto rowStatement = _nest->FindStatementByTypeAndVariable<ForAllStatement>(rowVariable);
+        auto loop = std::make_shared<BlockForAllStatement>(indexVariable, matrixStatement, rowStatement);
+        _nest->AddStatement(loop);
+        return ForAllStatementModifier(_nest, loop);
+    }
+
+    NestStatementAppender NestStatementAppender::Scratch(Variable scratchVariable, Variable topVariable, Variable leftVariable, int numRows, int numColumns, MatrixOrder order)
+    {
+        auto scratchLayout = GetPaddedLayout(MatrixLayout(numRows, numColumns, order));
+        auto topStatement = _nest->FindStatementByTypeAndVariable(topVariable);
+        auto leftStatement = _nest->FindStatementByTypeAndVariable(leftVariable);
+
+        auto scratch = std::make_shared<ScratchStatement>(scratchVariable, scratchLayout, topStatement, leftStatement);
+        _nest->AddStatement(scratch);
+
+        // add scratch allocation
+        auto statement = std::make_shared<UsingStatement>(scratchVariable, scratchLayout, false, nullptr);
+        _nest->AddStatement(statement);
+
         return *this;
     }
 
@@ -174,9 +1123,34 @@ namespace tiler
         return *this; 
     }
 
-    void NestStatementAppender::Print(std::ostream& stream) const
+    RecursiveKernelStatementModifier NestStatementAppender::RecursiveKernel(const Variable& matrixAVariable, const Variable& matrixBVariable, const Variable& matrixCVariable, KernelStatement::KernelType kernel, int baseM, int baseN, int baseK)
+    {
+        auto matrixAStatement = _nest->FindStatementByTypeAndVariable<MatrixStatement>(matrixAVariable);
+        auto matrixBStatement = _nest->FindStatementByTypeAndVariable<MatrixStatement>(matrixBVariable);
+        auto matrixCStatement = _nest->FindStatementByTypeAndVariable<MatrixStatement>(matrixCVariable);
+
+        auto kernelStatement = std::make_shared<RecursiveKernelStatement>(matrixAStatement, matrixBStatement, matrixCStatement, kernel, baseM, baseN, baseK);
+        _nest->AddStatement(kernelStatement);
+        return RecursiveKernelStatementModifier(_nest, kernelStatement); 
+    }
+
+    void NestStatementAppender::Print(std::ostream& stream, Instrumentation instrumentation) const
     { 
-        return _nest->Print(stream); 
+        return _nest->Print(stream, instrumentation); 
+    }
+
+    UsingStatementModifier::UsingStatementModifier(std::shared_ptr<Nest> nest, std::shared_ptr<UsingStatement> matrix) : NestStatementAppender(nest), _matrix(matrix)
+    {}
+
+    UsingStatementModifier UsingStatementModifier::Constant()
+    {
+        if(_matrix->IsOutput())
+        {
+            throw std::logic_error("matrix " + _matrix->GetVariable().GetName() + " must be an input to be constant");
+        }
+
+        _matrix->SetConstant();
+        return *this;
     }
 
     double ForAllStatementModifier::_loopCounter = 0;
@@ -189,9 +1163,41 @@ namespace tiler
     ForAllStatementModifier ForAllStatementModifier::Position(double Position) 
     { 
         _loop->SetPosition(Position); 
+        _loop->SetPositioned();
+        return *this; 
+    }
+
+    ForAllStatementModifier ForAllStatementModifier::Follows(Variable loopVariable) 
+    { 
+        auto predecessor = _nest->FindStatementByTypeAndVariable<ForAllStatement>(loopVariable);
+        _loop->SetPredecessor(predecessor); 
         return *this; 
     }
 
+    ForAllStatementModifier ForAllStatementModifier::Parallel()
+    {
+        if(IsPointerTo<BlockForAllStatement>(_loop))
+        {
+            throw std::logic_error("BlockForAll loop " + _loop->GetVariable().GetName() + " can't be parallel");
+        }
+
+        _loop->SetParallel(true);
+        return *this;
+    }
+
+    ForAllStatementModifier ForAllStatementModifier::Replicate(Variable matrixVariable)
+    {
+        auto matrixStatement = _nest->FindStatementByTypeAndVariable<UsingStatement>(matrixVariable);
+        if(matrixStatement->IsOutput())
+        {
+            throw std::logic_error("output " + matrixVariable.GetName() + " can't be replicated");
+        }
+
+        auto sparseStatement = std::dynamic_pointer_cast<BlockSparseUsingStatement>(matrixStatement);
+        _loop->AddReplica(matrixVariable.GetName(), sparseStatement != nullptr ? sparseStatement->GetStorageSize() : matrixStatement->GetLayout().GetDataSize());
+        return *this;
+    }
+
     TileStatementModifier::TileStatementModifier(std::shared_ptr<Nest> nest, std::shared_ptr<TileStatement> tile) : NestStatementAppender(nest), _tile(tile) 
     {}
 
@@ -199,7 +1205,7 @@ namespace tiler
     {
         _tile->SetCache(true);
         MatrixLayout oldLayout = _tile->GetLayout();
-        MatrixLayout newLayout {oldLayout.NumRows(), oldLayout.NumColumns(), order};
+        auto newLayout = GetPaddedLayout(MatrixLayout(oldLayout.NumRows(), oldLayout.NumColumns(), order));
         _tile->GetLayout() = newLayout;
 
         // add cache allocation
@@ -209,6 +1215,27 @@ namespace tiler
         return NestStatementAppender(_nest);
     }
 
+    NestStatementAppender TileStatementModifier::CacheShared(MatrixOrder order)
+    {
+        if(_tile->IsOutput())
+        {
+            throw std::logic_error("output tile " + _tile->GetVariable().GetName() + " can't be shared");
+        }
+
+        auto appender = Cache(order);
+        _tile->SetShared(true);
+        return appender;
+    }
+
+    RecursiveKernelStatementModifier::RecursiveKernelStatementModifier(std::shared_ptr<Nest> nest, std::shared_ptr<RecursiveKernelStatement> kernel) : NestStatementAppender(nest), _kernel(kernel) 
+    {}
+
+    RecursiveKernelStatementModifier RecursiveKernelStatementModifier::CacheAt(Variable matrixVariable, int depth, MatrixOrder order)
+    {
+        _kernel->AddCache(matrixVariable, depth, order);
+        return *this;
+    }
+
     NestStatementAppender MakeNest()
     {
         auto nest = std::make_shared<Nest>();
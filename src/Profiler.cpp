@@ -0,0 +1,384 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     Profiler.cpp
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "PrintUtils.h"
+#include "Profiler.h"
+
+namespace tiler
+{
+    const char* profileFunctions = 
+    R"AW(#include <algorithm>
+    #include <chrono>
+    #include <cstdio>
+    #include <cstdlib>
+    #if PROFILE_COUNTERS
+    #include <cstring>
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #endif
+
+    const int profileNumCounters = 4;
+    const char* profileCounterNames[profileNumCounters] = {"cycles", "l1d_misses", "llc_misses", "dtlb_misses"};
+    int profileCounterFile = -1;
+
+    struct ProfileSample
+    {
+        long long nanoseconds;
+        long long counters[profileNumCounters];
+    };
+
+    // the totals of a sampled entry cover its sampled calls, and the report scales them to all its calls
+    struct ProfileEntry
+    {
+        long long calls;
+        long long samples;
+        long long nanoseconds;
+        long long counters[profileNumCounters];
+    };
+
+    // a kernel call or a cache copy can be too short to read the clock around each one, so one call in profileSamplePeriod is
+    // timed, and the cost of reading the clock is subtracted from each sample
+    const long long profileSamplePeriod = 64;
+    long long profileSampleOverhead = 0;
+
+    void ProfileOpenCounters()
+    {
+    #if PROFILE_COUNTERS
+        // cycles, L1 data read misses, last level cache misses, data TLB read misses
+        unsigned long long configs[profileNumCounters][2] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}};
+
+        int files[profileNumCounters];
+        for(int i = 0; i < profileNumCounters; ++i)
+        {
+            perf_event_attr attributes;
+            memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = configs[i][0];
+            attributes.config = configs[i][1];
+            attributes.read_format = PERF_FORMAT_GROUP;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+
+            files[i] = syscall(SYS_perf_event_open, &attributes, 0, -1, (i == 0) ? -1 : files[0], 0);
+            if(files[i] < 0)
+            {
+                fprintf(stderr, "warning: hardware counters are unavailable, profiling with timers only\n");
+                for(int j = 0; j < i; ++j)
+                {
+                    close(files[j]);
+                }
+                return;
+            }
+        }
+        profileCounterFile = files[0];
+    #endif
+    }
+
+    void ProfileReadCounters(long long* counters)
+    {
+    #if PROFILE_COUNTERS
+        if(profileCounterFile >= 0)
+        {
+            unsigned long long values[1 + profileNumCounters];
+            if(read(profileCounterFile, values, sizeof(values)) == sizeof(values))
+            {
+                for(int i = 0; i < profileNumCounters; ++i)
+                {
+                    counters[i] = values[1 + i];
+                }
+            }
+        }
+    #endif
+    }
+
+    long long ProfileNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    ProfileSample ProfileStart()
+    {
+        ProfileSample sample = {};
+        ProfileReadCounters(sample.counters);
+        sample.nanoseconds = ProfileNanoseconds();
+        return sample;
+    }
+
+    void ProfileAccumulate(ProfileEntry& entry, const ProfileSample& start, long long overhead = 0)
+    {
+        long long nanoseconds = ProfileNanoseconds() - overhead;
+        long long counters[profileNumCounters] = {};
+        ProfileReadCounters(counters);
+
+        __atomic_fetch_add(&entry.nanoseconds, std::max(nanoseconds - start.nanoseconds, 0LL), __ATOMIC_RELAXED);
+        for(int i = 0; i < profileNumCounters; ++i)
+        {
+            __atomic_fetch_add(&entry.counters[i], counters[i] - start.counters[i], __ATOMIC_RELAXED);
+        }
+    }
+
+    void ProfileStop(ProfileEntry& entry, const ProfileSample& start)
+    {
+        ProfileAccumulate(entry, start);
+        __atomic_fetch_add(&entry.calls, 1, __ATOMIC_RELAXED);
+    }
+
+    // measures the shortest time of an empty sample
+    void ProfileCalibrate()
+    {
+        ProfileEntry entry = {};
+        long long overhead = -1;
+        for(int i = 0; i < 1000; ++i)
+        {
+            long long total = entry.nanoseconds;
+            ProfileAccumulate(entry, ProfileStart());
+            overhead = (overhead < 0) ? entry.nanoseconds - total : std::min(overhead, entry.nanoseconds - total);
+        }
+        profileSampleOverhead = overhead;
+    }
+
+    // counts every call, and only starts the timer of the sampled calls (the others get a negative start time)
+    ProfileSample ProfileSampleStart(ProfileEntry& entry)
+    {
+        if(__atomic_fetch_add(&entry.calls, 1, __ATOMIC_RELAXED) % profileSamplePeriod != 0)
+        {
+            ProfileSample skipped = {};
+            skipped.nanoseconds = -1;
+            return skipped;
+        }
+        return ProfileStart();
+    }
+
+    void ProfileSampleStop(ProfileEntry& entry, const ProfileSample& start)
+    {
+        if(start.nanoseconds >= 0)
+        {
+            ProfileAccumulate(entry, start, profileSampleOverhead);
+            __atomic_fetch_add(&entry.samples, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    // scales the totals of sampled entries to all their calls
+    void ProfileScaleSamples(ProfileEntry* entries, int size)
+    {
+        for(int i = 0; i < size; ++i)
+        {
+            if(entries[i].samples > 0)
+            {
+                double scale = (double)entries[i].calls / entries[i].samples;
+                entries[i].nanoseconds = (long long)(entries[i].nanoseconds * scale);
+                for(int j = 0; j < profileNumCounters; ++j)
+                {
+                    entries[i].counters[j] = (long long)(entries[i].counters[j] * scale);
+                }
+                entries[i].samples = entries[i].calls;
+            }
+        }
+    }
+
+    // prints a table to stderr, or writes JSON to the file named by TILER_PROFILE_JSON
+    void ProfileReport(const char* const* names, ProfileEntry* entries, int size)
+    {
+        ProfileScaleSamples(entries, size);
+        int numCounters = (profileCounterFile >= 0) ? profileNumCounters : 0;
+        double totalNanoseconds = (entries[0].nanoseconds > 0) ? (double)entries[0].nanoseconds : 1.0;
+
+        const char* jsonPath = getenv("TILER_PROFILE_JSON");
+        if(jsonPath != nullptr)
+        {
+            FILE* file = fopen(jsonPath, "w");
+            if(file == nullptr)
+            {
+                perror(jsonPath);
+                return;
+            }
+
+            fprintf(file, "{\n  \"statements\": [\n");
+            for(int i = 0; i < size; ++i)
+            {
+                fprintf(file, "    {\"name\": \"%s\", \"calls\": %lld, \"seconds\": %.9f, \"percent\": %.2f", names[i], entries[i].calls, entries[i].nanoseconds * 1e-9, 100.0 * entries[i].nanoseconds / totalNanoseconds);
+                for(int j = 0; j < numCounters; ++j)
+                {
+                    fprintf(file, ", \"%s\": %lld", profileCounterNames[j], entries[i].counters[j]);
+                }
+                fprintf(file, "}%s\n", (i + 1 < size) ? "," : "");
+            }
+            fprintf(file, "  ]\n}\n");
+            fclose(file);
+            return;
+        }
+
+        fprintf(stderr, "%-28s %12s %14s %8s", "statement", "calls", "seconds", "percent");
+        for(int j = 0; j < numCounters; ++j)
+        {
+            fprintf(stderr, " %14s", profileCounterNames[j]);
+        }
+        fprintf(stderr, "\n");
+
+        for(int i = 0; i < size; ++i)
+        {
+            fprintf(stderr, "%-28s %12lld %14.9f %8.2f", names[i], entries[i].calls, entries[i].nanoseconds * 1e-9, 100.0 * entries[i].nanoseconds / totalNanoseconds);
+            for(int j = 0; j < numCounters; ++j)
+            {
+                fprintf(stderr, " %14lld", entries[i].counters[j]);
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+    )AW";
+
+    StatementProfiler::StatementProfiler(Instrumentation instrumentation, const std::vector<StatementPtr>& statements) : _instrumentation(instrumentation)
+    {
+        if(_instrumentation == Instrumentation::none)
+        {
+            return;
+        }
+
+        // entry 0 covers the entire nest, loop entries cover all the iterations of the loop
+        AddEntry("Nest");
+        for(const auto& statement : statements)
+        {
+            auto name = statement->GetVariable().GetName();
+
+            if(std::dynamic_pointer_cast<ForAllStatement>(statement) != nullptr)
+            {
+                _forwardEntries[statement.get()] = AddEntry("ForAll " + name);
+            }
+
+            auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement);
+            if(tileStatement != nullptr && tileStatement->IsCached())
+            {
+                _forwardEntries[statement.get()] = AddEntry("Tile " + name + " copy");
+                if(tileStatement->IsOutput())
+                {
+                    _backwardEntries[statement.get()] = AddEntry("Tile " + name + " copy back");
+                }
+            }
+
+            if(std::dynamic_pointer_cast<KernelStatement>(statement) != nullptr)
+            {
+                _forwardEntries[statement.get()] = AddEntry("Kernel " + name);
+            }
+        }
+    }
+
+    void StatementProfiler::PrintFunctions(std::ostream& stream) const
+    {
+        if(_instrumentation == Instrumentation::none)
+        {
+            return;
+        }
+
+        stream << "#define PROFILE_COUNTERS " << ((_instrumentation == Instrumentation::counters) ? 1 : 0) << "\n";
+        stream << profileFunctions << std::endl;
+
+        stream << Indent;
+        PrintFormated(stream, "const char* profileNames[%] = {", _names.size());
+        for(int i = 0; i < (int)_names.size(); ++i)
+        {
+            stream << ((i == 0) ? "\"" : ", \"") << _names[i] << "\"";
+        }
+        stream << "};\n";
+
+        stream << Indent;
+        PrintFormated(stream, "ProfileEntry profileEntries[%] = {};\n", _names.size());
+    }
+
+    void StatementProfiler::PrintStart(std::ostream& stream) const
+    {
+        if(_instrumentation == Instrumentation::none)
+        {
+            return;
+        }
+
+        stream << Indent << "ProfileOpenCounters();\n";
+        stream << Indent << "ProfileCalibrate();\n";
+        PrintTimerStart(stream, 0, false);
+    }
+
+    void StatementProfiler::PrintForward(std::ostream& stream, const StatementPtr& statement) const
+    {
+        auto entry = _forwardEntries.find(statement.get());
+        if(entry == _forwardEntries.end())
+        {
+            statement->PrintForward(stream);
+            return;
+        }
+
+        // loop timers are stopped after the loop is closed, in the backward pass, and the timers of kernels and copies are sampled
+        bool isLoop = std::dynamic_pointer_cast<ForAllStatement>(statement) != nullptr;
+        PrintTimerStart(stream, entry->second, !isLoop);
+        statement->PrintForward(stream);
+        if(!isLoop)
+        {
+            PrintTimerStop(stream, entry->second, true);
+        }
+    }
+
+    void StatementProfiler::PrintBackward(std::ostream& stream, const StatementPtr& statement) const
+    {
+        auto entry = _backwardEntries.find(statement.get());
+        if(entry != _backwardEntries.end())
+        {
+            PrintTimerStart(stream, entry->second, true);
+            statement->PrintBackward(stream);
+            PrintTimerStop(stream, entry->second, true);
+            return;
+        }
+
+        statement->PrintBackward(stream);
+
+        entry = _forwardEntries.find(statement.get());
+        if(entry != _forwardEntries.end() && std::dynamic_pointer_cast<ForAllStatement>(statement) != nullptr)
+        {
+            PrintTimerStop(stream, entry->second, false);
+        }
+    }
+
+    void StatementProfiler::PrintReport(std::ostream& stream) const
+    {
+        if(_instrumentation == Instrumentation::none)
+        {
+            return;
+        }
+
+        PrintTimerStop(stream, 0, false);
+        stream << Indent;
+        PrintFormated(stream, "ProfileReport(profileNames, profileEntries, %);\n", _names.size());
+    }
+
+    int StatementProfiler::AddEntry(const std::string& name)
+    {
+        _names.push_back(name);
+        return (int)_names.size() - 1;
+    }
+
+    void StatementProfiler::PrintTimerStart(std::ostream& stream, int entry, bool isSampled) const
+    {
+        stream << Indent;
+        if(isSampled)
+        {
+            PrintFormated(stream, "ProfileSample profile_% = ProfileSampleStart(profileEntries[%]);\n", entry, entry);
+        }
+        else
+        {
+            PrintFormated(stream, "ProfileSample profile_% = ProfileStart();\n", entry);
+        }
+    }
+
+    void StatementProfiler::PrintTimerStop(std::ostream& stream, int entry, bool isSampled) const
+    {
+        stream << Indent;
+        PrintFormated(stream, "%(profileEntries[%], profile_%);\n", isSampled ? "ProfileSampleStop" : "ProfileStop", entry, entry);
+    }
+}
@@ -0,0 +1,358 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     Schedule.cpp
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Kernel.h"
+#include "Schedule.h"
+
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace tiler
+{
+    // renames variables x0, x1, ... in order of appearance
+    class ScheduleNames
+    {
+    public:
+        std::string operator()(const Variable& variable)
+        {
+            return (*this)(variable.GetName());
+        }
+
+        std::string operator()(const std::string& name)
+        {
+            auto iter = _names.find(name);
+            if(iter != _names.end())
+            {
+                return iter->second;
+            }
+
+            auto scheduleName = "x" + std::to_string(_names.size());
+            _names[name] = scheduleName;
+            return scheduleName;
+        }
+
+        bool Contains(const Variable& variable) const { return _names.count(variable.GetName()) > 0; }
+
+    private:
+        std::map<std::string, std::string> _names;
+    };
+
+    void PrintScheduleLayout(std::ostream& stream, const MatrixLayout& layout)
+    {
+        stream << layout.NumRows() << " " << layout.NumColumns() << " " << GetOrderName(layout.GetOrder()) << " " << layout.GetLeadingDimensionSize() << " " << layout.GetBlockSize();
+    }
+
+    void SerializeNest(const Nest& nest, std::ostream& stream)
+    {
+        ScheduleNames names;
+        auto precision = stream.precision(std::numeric_limits<double>::max_digits10);
+
+        for(const auto& statement : nest.GetStatements())
+        {
+            if(std::dynamic_pointer_cast<CombinationUsingStatement>(statement) != nullptr)
+            {
+                throw std::logic_error("combination " + statement->GetVariable().GetName() + " can't be serialized");
+            }
+            else if(auto paddedStatement = std::dynamic_pointer_cast<PaddedUsingStatement>(statement))
+            {
+                stream << "padded " << names(paddedStatement->GetVariable()) << " ";
+                PrintScheduleLayout(stream, paddedStatement->GetDataLayout());
+                stream << (paddedStatement->IsConstant() ? " constant\n" : "\n");
+            }
+            else if(auto sparseStatement = std::dynamic_pointer_cast<BlockSparseUsingStatement>(statement))
+            {
+                auto blockLayout = sparseStatement->GetBlockLayout();
+                stream << "sparse " << names(sparseStatement->GetVariable()) << " ";
+                PrintScheduleLayout(stream, sparseStatement->GetLayout());
+                stream << " " << blockLayout.NumRows() << " " << blockLayout.NumColumns() << "\n";
+            }
+            else if(auto mappedStatement = std::dynamic_pointer_cast<MappedUsingStatement>(statement))
+            {
+                stream << "mapped " << names(mappedStatement->GetVariable()) << " ";
+                PrintScheduleLayout(stream, mappedStatement->GetLayout());
+                stream << " " << mappedStatement->IsOutput() << " " << mappedStatement->GetPath() << "\n";
+            }
+            else if(auto usingStatement = std::dynamic_pointer_cast<UsingStatement>(statement))
+            {
+                // cache and scratch allocations are recreated by their tile and scratch statements
+                if(names.Contains(usingStatement->GetVariable()))
+                {
+                    continue;
+                }
+
+                stream << "using " << names(usingStatement->GetVariable()) << " ";
+                PrintScheduleLayout(stream, usingStatement->GetLayout());
+                stream << " " << usingStatement->IsOutput() << (usingStatement->IsConstant() ? " constant\n" : "\n");
+            }
+            else if(auto loop = std::dynamic_pointer_cast<ForAllStatement>(statement))
+            {
+                auto blockLoop = std::dynamic_pointer_cast<BlockForAllStatement>(loop);
+                if(blockLoop != nullptr)
+                {
+                    stream << "blocks " << names(loop->GetVariable()) << " " << names(blockLoop->GetMatrixStatement()->GetVariable()) << " " << names(blockLoop->GetRowStatement()->GetVariable()) << " " << loop->GetPosition();
+                }
+                else
+                {
+                    stream << "forall " << names(loop->GetVariable()) << " " << loop->GetStart() << " " << loop->GetStop() << " " << loop->GetStep() << " " << loop->GetPosition();
+                }
+                if(loop->IsPositioned())
+                {
+                    stream << " positioned";
+                }
+                if(loop->GetPredecessor() != nullptr)
+                {
+                    stream << " follows " << names(loop->GetPredecessor()->GetVariable());
+                }
+                if(loop->IsParallel())
+                {
+                    stream << " parallel";
+                }
+                for(const auto& replicaName : loop->GetReplicaNames())
+                {
+                    stream << " replicate " << names(replicaName);
+                }
+                stream << "\n";
+            }
+            else if(auto tile = std::dynamic_pointer_cast<TileStatement>(statement))
+            {
+                const auto& layout = tile->GetLayout();
+                stream << "tile " << names(tile->GetVariable()) << " " << names(tile->GetMatrixStatement()->GetVariable()) << " " << names(tile->GetTopStatement()->GetVariable()) << " " << names(tile->GetLeftStatement()->GetVariable()) << " " << layout.NumRows() << " " << layout.NumColumns();
+                if(tile->IsCached())
+                {
+                    stream << " cache " << GetOrderName(layout.GetOrder());
+                }
+                if(tile->IsShared())
+                {
+                    stream << " shared";
+                }
+                stream << "\n";
+            }
+            else if(auto scratch = std::dynamic_pointer_cast<ScratchStatement>(statement))
+            {
+                const auto& layout = scratch->GetLayout();
+                stream << "scratch " << names(scratch->GetVariable()) << " " << names(scratch->GetTopStatement()->GetVariable()) << " " << names(scratch->GetLeftStatement()->GetVariable()) << " " << layout.NumRows() << " " << layout.NumColumns() << " " << GetOrderName(layout.GetOrder()) << "\n";
+            }
+            else if(auto kernel = std::dynamic_pointer_cast<KernelStatement>(statement))
+            {
+                auto recursiveKernel = std::dynamic_pointer_cast<RecursiveKernelStatement>(kernel);
+                stream << (recursiveKernel != nullptr ? "recursive " : "kernel ") << names(kernel->GetMatrixAStatement()->GetVariable()) << " " << names(kernel->GetMatrixBStatement()->GetVariable()) << " " << names(kernel->GetMatrixCStatement()->GetVariable()) << " " << GetKernelName(kernel->GetKernel());
+                if(recursiveKernel != nullptr)
+                {
+                    stream << " " << recursiveKernel->GetBaseM() << " " << recursiveKernel->GetBaseN() << " " << recursiveKernel->GetBaseK();
+
+                    KernelStatement::MatrixStatementPtr operands[] = { kernel->GetMatrixAStatement(), kernel->GetMatrixBStatement(), kernel->GetMatrixCStatement() };
+                    for(const auto& directive : recursiveKernel->GetCacheDirectives())
+                    {
+                        stream << " cache " << names(operands[directive.operand]->GetVariable()) << " " << directive.depth << " " << GetOrderName(directive.order);
+                    }
+                }
+                stream << "\n";
+            }
+            else
+            {
+                throw std::logic_error("statement that corresponds to variable " + statement->GetVariable().GetName() + " can't be serialized");
+            }
+        }
+
+        stream.precision(precision);
+    }
+
+    std::shared_ptr<Nest> DeserializeNest(std::istream& stream, const std::vector<float*>& data)
+    {
+        return DeserializeNest(stream, {}, data);
+    }
+
+    // a line of a schedule, split into words (the path of a mapped matrix is a single word that extends to the end of the line)
+    using ScheduleLine = std::vector<std::string>;
+
+    std::vector<ScheduleLine> ReadSchedule(std::istream& stream)
+    {
+        std::vector<ScheduleLine> lines;
+        std::string text;
+        while(std::getline(stream, text))
+        {
+            std::istringstream lineStream(text);
+            ScheduleLine line;
+            std::string word;
+            while(lineStream >> word)
+            {
+                line.push_back(word);
+                if(line[0] == "mapped" && line.size() == 8)
+                {
+                    std::string path;
+                    std::getline(lineStream >> std::ws, path);
+                    line.push_back(path);
+                    break;
+                }
+            }
+
+            if(!line.empty())
+            {
+                lines.push_back(line);
+            }
+        }
+        return lines;
+    }
+
+    MatrixLayout ReadScheduleLayout(const ScheduleLine& line, int index)
+    {
+        return MatrixLayout(std::stoi(line.at(index)), std::stoi(line.at(index + 1)), GetOrderByName(line.at(index + 2)), std::stoi(line.at(index + 3)), std::stoi(line.at(index + 4)));
+    }
+
+    std::shared_ptr<Nest> DeserializeNest(std::istream& stream, const std::vector<MatrixLayout>& layouts, const std::vector<float*>& data)
+    {
+        auto lines = ReadSchedule(stream);
+
+        // find the layouts of the Using statements, before and after replacement
+        std::map<std::string, MatrixLayout> oldLayouts;
+        std::map<std::string, MatrixLayout> newLayouts;
+        for(const auto& line : lines)
+        {
+            if(line[0] == "using" || line[0] == "padded" || line[0] == "mapped" || line[0] == "sparse")
+            {
+                auto layout = ReadScheduleLayout(line, 2);
+                oldLayouts.emplace(line.at(1), layout);
+                newLayouts.emplace(line.at(1), newLayouts.size() < layouts.size() ? layouts[newLayouts.size()] : layout);
+            }
+        }
+
+        // retarget loops that span the rows or columns of a replaced matrix
+        std::map<std::string, int> newStops;
+        std::map<std::string, const ScheduleLine*> loopLines;
+        for(const auto& line : lines)
+        {
+            if(line[0] == "forall")
+            {
+                loopLines[line.at(1)] = &line;
+            }
+            else if(line[0] == "tile" && oldLayouts.count(line.at(2)) > 0)
+            {
+                const auto& oldLayout = oldLayouts.at(line.at(2));
+                const auto& newLayout = newLayouts.at(line.at(2));
+                std::pair<std::string, std::pair<int, int>> spans[] = { {line.at(3), {oldLayout.NumRows(), newLayout.NumRows()}}, {line.at(4), {oldLayout.NumColumns(), newLayout.NumColumns()}} };
+                for(const auto& span : spans)
+                {
+                    auto loopLine = loopLines.find(span.first);
+                    if(loopLine != loopLines.end() && std::stoi(loopLine->second->at(2)) == 0 && std::stoi(loopLine->second->at(3)) == span.second.first)
+                    {
+                        newStops[span.first] = span.second.second;
+                    }
+                }
+            }
+        }
+
+        // rebuild the nest through the appender, which recreates cache and scratch allocations
+        NestStatementAppender appender(std::make_shared<Nest>());
+        std::map<std::string, Variable> variables;
+        auto getVariable = [&](const std::string& name) { return variables.emplace(name, Variable()).first->second; };
+        size_t dataIndex = 0;
+
+        for(const auto& line : lines)
+        {
+            const auto& type = line[0];
+            if(type == "using")
+            {
+                auto dataPointer = dataIndex < data.size() ? data[dataIndex] : nullptr;
+                ++dataIndex;
+                auto matrix = appender.Using(getVariable(line.at(1)), newLayouts.at(line.at(1)), std::stoi(line.at(7)) != 0, dataPointer);
+                if(line.size() > 8 && line[8] == "constant")
+                {
+                    matrix.Constant();
+                }
+            }
+            else if(type == "padded")
+            {
+                auto dataPointer = dataIndex < data.size() ? data[dataIndex] : nullptr;
+                ++dataIndex;
+                auto matrix = appender.UsingPadded(getVariable(line.at(1)), newLayouts.at(line.at(1)), dataPointer);
+                if(line.size() > 7 && line[7] == "constant")
+                {
+                    matrix.Constant();
+                }
+            }
+            else if(type == "sparse")
+            {
+                auto dataPointer = dataIndex < data.size() ? data[dataIndex] : nullptr;
+                ++dataIndex;
+                appender.UsingBlockSparse(getVariable(line.at(1)), newLayouts.at(line.at(1)), std::stoi(line.at(7)), std::stoi(line.at(8)), dataPointer);
+            }
+            else if(type == "mapped")
+            {
+                ++dataIndex;
+                appender.UsingMapped(getVariable(line.at(1)), newLayouts.at(line.at(1)), std::stoi(line.at(7)) != 0, line.at(8));
+            }
+            else if(type == "forall" || type == "blocks")
+            {
+                // a BlockForAll loop names its matrix and row index instead of a range, and both kinds of loops end with their position and flags
+                bool isBlockLoop = (type == "blocks");
+                size_t positionIndex = isBlockLoop ? 4 : 5;
+                auto loop = isBlockLoop ? appender.ForAllBlocks(getVariable(line.at(1)), getVariable(line.at(2)), getVariable(line.at(3)))
+                    : appender.ForAll(getVariable(line.at(1)), std::stoi(line.at(2)), newStops.count(line.at(1)) > 0 ? newStops.at(line.at(1)) : std::stoi(line.at(3)), std::stoi(line.at(4)));
+                // only a loop positioned by the user keeps its position when the scheduler reorders loops
+                auto position = std::stod(line.at(positionIndex));
+                appender.GetNest()->GetStatements().back()->SetPosition(position);
+                for(size_t index = positionIndex + 1; index < line.size(); ++index)
+                {
+                    if(line[index] == "positioned")
+                    {
+                        loop.Position(position);
+                    }
+                    else if(line[index] == "follows")
+                    {
+                        loop.Follows(getVariable(line.at(++index)));
+                    }
+                    else if(line[index] == "parallel")
+                    {
+                        loop.Parallel();
+                    }
+                    else if(line[index] == "replicate")
+                    {
+                        loop.Replicate(getVariable(line.at(++index)));
+                    }
+                }
+            }
+            else if(type == "tile")
+            {
+                auto tile = appender.Tile(getVariable(line.at(1)), getVariable(line.at(2)), getVariable(line.at(3)), getVariable(line.at(4)), std::stoi(line.at(5)), std::stoi(line.at(6)));
+                if(line.size() > 9 && line[9] == "shared")
+                {
+                    tile.CacheShared(GetOrderByName(line.at(8)));
+                }
+                else if(line.size() > 7)
+                {
+                    tile.Cache(GetOrderByName(line.at(8)));
+                }
+            }
+            else if(type == "scratch")
+            {
+                appender.Scratch(getVariable(line.at(1)), getVariable(line.at(2)), getVariable(line.at(3)), std::stoi(line.at(4)), std::stoi(line.at(5)), GetOrderByName(line.at(6)));
+            }
+            else if(type == "kernel")
+            {
+                appender.Kernel(getVariable(line.at(1)), getVariable(line.at(2)), getVariable(line.at(3)), GetKernelByName(line.at(4)));
+            }
+            else if(type == "recursive")
+            {
+                auto kernel = appender.RecursiveKernel(getVariable(line.at(1)), getVariable(line.at(2)), getVariable(line.at(3)), GetKernelByName(line.at(4)), std::stoi(line.at(5)), std::stoi(line.at(6)), std::stoi(line.at(7)));
+                for(size_t index = 8; index + 3 < line.size() && line[index] == "cache"; index += 4)
+                {
+                    kernel.CacheAt(getVariable(line.at(index + 1)), std::stoi(line.at(index + 2)), GetOrderByName(line.at(index + 3)));
+                }
+            }
+            else
+            {
+                throw std::logic_error("unknown schedule statement " + type);
+            }
+        }
+
+        return appender.GetNest();
+    }
+}
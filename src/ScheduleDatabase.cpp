@@ -0,0 +1,156 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     ScheduleDatabase.cpp
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Schedule.h"
+#include "ScheduleDatabase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+namespace tiler
+{
+    std::string GetCpuModel()
+    {
+        std::ifstream cpuInfo("/proc/cpuinfo");
+        std::string line;
+        while(std::getline(cpuInfo, line))
+        {
+            if(line.compare(0, 10, "model name") == 0)
+            {
+                auto colon = line.find(':');
+                if(colon != std::string::npos)
+                {
+                    return line.substr(line.find_first_not_of(" \t", colon + 1));
+                }
+            }
+        }
+        return "unknown";
+    }
+
+    bool HaveSameProblem(const ScheduleKey& key1, const ScheduleKey& key2)
+    {
+        return std::tie(key1.orderA, key1.orderB, key1.orderC, key1.dataType) == std::tie(key2.orderA, key2.orderB, key2.orderC, key2.dataType);
+    }
+
+    double GetShapeDistance(const ScheduleKey& key1, const ScheduleKey& key2)
+    {
+        return std::abs(std::log2(double(key1.m) / key2.m)) + std::abs(std::log2(double(key1.n) / key2.n)) + std::abs(std::log2(double(key1.k) / key2.k));
+    }
+
+    void ScheduleDatabase::Add(const ScheduleKey& key, const Nest& nest)
+    {
+        std::ostringstream schedule;
+        SerializeNest(nest, schedule);
+        Add(key, schedule.str());
+    }
+
+    void ScheduleDatabase::Add(const ScheduleKey& key, const std::string& schedule)
+    {
+        for(auto& entry : _entries)
+        {
+            if(HaveSameProblem(entry.key, key) && entry.key.cpuModel == key.cpuModel && GetShapeDistance(entry.key, key) == 0)
+            {
+                entry.schedule = schedule;
+                return;
+            }
+        }
+        _entries.push_back({key, schedule});
+    }
+
+    std::vector<std::string> ScheduleDatabase::FindNearest(const ScheduleKey& key) const
+    {
+        std::vector<std::tuple<bool, double, int>> candidates;
+        for(int index = 0; index < Size(); ++index)
+        {
+            const auto& entryKey = _entries[index].key;
+            if(HaveSameProblem(entryKey, key))
+            {
+                candidates.emplace_back(entryKey.cpuModel != key.cpuModel, GetShapeDistance(entryKey, key), index);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        std::vector<std::string> schedules;
+        for(const auto& candidate : candidates)
+        {
+            schedules.push_back(_entries[std::get<2>(candidate)].schedule);
+        }
+        return schedules;
+    }
+
+    // the database is a sequence of entries: a header line with the key, the schedule, and a line with the word end
+    void ScheduleDatabase::Load(std::istream& stream)
+    {
+        std::string line;
+        while(std::getline(stream, line))
+        {
+            std::istringstream header(line);
+            std::string word;
+            if(!(header >> word))
+            {
+                continue;
+            }
+
+            if(word != "schedule")
+            {
+                throw std::logic_error("expected a schedule header in the schedule database");
+            }
+
+            ScheduleKey key;
+            std::string orderA, orderB, orderC;
+            if(!(header >> key.m >> key.n >> key.k >> orderA >> orderB >> orderC >> key.dataType))
+            {
+                throw std::logic_error("malformed schedule header " + line);
+            }
+            std::getline(header >> std::ws, key.cpuModel);
+            key.orderA = GetOrderByName(orderA);
+            key.orderB = GetOrderByName(orderB);
+            key.orderC = GetOrderByName(orderC);
+
+            std::string schedule;
+            while(std::getline(stream, line) && line != "end")
+            {
+                schedule += line + "\n";
+            }
+            Add(key, schedule);
+        }
+    }
+
+    void ScheduleDatabase::Save(std::ostream& stream) const
+    {
+        for(const auto& entry : _entries)
+        {
+            const auto& key = entry.key;
+            stream << "schedule " << key.m << " " << key.n << " " << key.k << " " << GetOrderName(key.orderA) << " " << GetOrderName(key.orderB) << " " << GetOrderName(key.orderC) << " " << key.dataType << " " << key.cpuModel << "\n";
+            stream << entry.schedule << "end\n";
+        }
+    }
+
+    std::shared_ptr<Nest> DispatchSchedule(const ScheduleDatabase& database, MatrixLayout layoutA, MatrixLayout layoutB, MatrixLayout layoutC, float* dataA, float* dataB, float* dataC)
+    {
+        ScheduleKey key {layoutC.NumRows(), layoutC.NumColumns(), layoutA.NumColumns(), layoutA.GetOrder(), layoutB.GetOrder(), layoutC.GetOrder(), "float", GetCpuModel()};
+
+        // nearby shapes may have tiles that don't fit this problem, in which case the next one is tried
+        for(const auto& schedule : database.FindNearest(key))
+        {
+            try
+            {
+                std::istringstream stream(schedule);
+                return DeserializeNest(stream, {layoutA, layoutB, layoutC}, {dataA, dataB, dataC});
+            }
+            catch(const std::logic_error&)
+            {}
+        }
+
+        throw std::logic_error("no schedule in the database fits a " + std::to_string(key.m) + "x" + std::to_string(key.n) + "x" + std::to_string(key.k) + " problem");
+    }
+}
@@ -10,6 +10,7 @@
 #include "Statement.h"
 
 #include <algorithm>
+#include <stdexcept>
 
 namespace tiler
 {
@@ -38,16 +39,219 @@ namespace tiler
     void ForAllStatement::PrintForward(std::ostream& stream) const
     {
         auto name = GetVariable().GetName();
+        for(const auto& pointer : _inductionPointers)
+        {
+            stream << Indent;
+            PrintFormated(stream, "float* % = %;    // induction pointer, stride:%\n", pointer.name, pointer.initialValue, pointer.stride);
+        }
+
+        if(_parallel)
+        {
+            // a thread of a split loop runs at least 256 values of the index, so that summing its partial outputs is cheap next to
+            // its multiply-adds, and all the partial outputs together take at most 2^26 floats
+            int numIterations = std::max((GetStop() - GetStart() + GetStep() - 1) / GetStep(), 0);
+            int maxThreads = numIterations;
+            if(!_partials.empty())
+            {
+                long partialsSize = 0;
+                for(const auto& partial : _partials)
+                {
+                    partialsSize += partial.matrixSize;
+                }
+                maxThreads = std::min({maxThreads, std::max(1, (GetStop() - GetStart()) / 256), static_cast<int>(std::max(1L, (1L << 26) / partialsSize))});
+            }
+
+            stream << Indent;
+            PrintFormated(stream, "const int %_team = ParallelTeamSize(%, %, %);\n", name, numIterations, maxThreads, _lockstep ? "true" : "false");
+            for(const auto& replica : _replicas)
+            {
+                stream << Indent;
+                PrintFormated(stream, "std::vector<float*> %_replicas = ReplicatePerNode(%, %);\n", replica.matrixName, replica.matrixName, replica.matrixSize);
+            }
+            for(const auto& partial : _partials)
+            {
+                stream << Indent;
+                PrintFormated(stream, "std::vector<float*> %_partials = AllocatePartials(%, %_team);\n", partial.matrixName, partial.matrixSize, name);
+            }
+
+            stream << Indent;
+            PrintFormated(stream, "ParallelFor(%, %, %, %_team, [&](int %)    // parallel ForAll statement, position:%\n", GetStart(), GetStop(), GetStep(), name, name, GetPosition());
+            stream << Indent << "{\n";
+            IncreaseIndent();
+
+            // the copy of each replicated matrix on the node of the thread, and the partial copy of each split output, shadow the original
+            for(const auto& replica : _replicas)
+            {
+                stream << Indent;
+                PrintFormated(stream, "float* % = %_replicas[parallelNode];\n", replica.matrixName, replica.matrixName);
+            }
+            for(const auto& partial : _partials)
+            {
+                stream << Indent;
+                PrintFormated(stream, "float* % = %_partials[parallelThread];\n", partial.matrixName, partial.matrixName);
+            }
+        }
+        else
+        {
+            stream << Indent;
+            PrintFormated(stream, "for(int % = %; % < %; % += %)    // ForAll statement, position:%\n", name, GetStart(), name, GetStop(), name, GetStep(), GetPosition());
+            stream << Indent << "{\n";
+            IncreaseIndent();
+        }
+
+        for(const auto& prefetch : _panelPrefetches)
+        {
+            stream << Indent;
+            PrintFormated(stream, "AdviseWillNeed(%, %, (% + %) * %, % * %);    // prefetch next panel\n", prefetch.matrixName, prefetch.matrixSize, name, GetStep(), prefetch.panelStride, GetStep(), prefetch.panelStride);
+        }
+    }
+
+    void ForAllStatement::PrintBackward(std::ostream& stream) const
+    {
+        for(const auto& pointer : _inductionPointers)
+        {
+            stream << Indent;
+            PrintFormated(stream, "% += %;\n", pointer.name, pointer.stride);
+        }
+
+        DecreaseIndent();
+        if(_parallel)
+        {
+            stream << Indent << "});\n";
+            for(const auto& replica : _replicas)
+            {
+                stream << Indent;
+                PrintFormated(stream, "FreeReplicas(%_replicas);\n", replica.matrixName);
+            }
+            for(const auto& partial : _partials)
+            {
+                stream << Indent;
+                PrintFormated(stream, "ReducePartials(%, %_partials, %);\n", partial.matrixName, partial.matrixName, partial.matrixSize);
+            }
+        }
+        else
+        {
+            stream << Indent << "}\n";
+        }
+    }
+
+    void ForAllStatement::AddReplica(const std::string& matrixName, int matrixSize)
+    {
+        if(!_parallel)
+        {
+            throw std::logic_error("only parallel loops replicate matrices");
+        }
+
+        for(const auto& replica : _replicas)
+        {
+            if(replica.matrixName == matrixName)
+            {
+                return;
+            }
+        }
+        _replicas.push_back({matrixName, matrixSize});
+    }
+
+    void ForAllStatement::AddPartial(const std::string& matrixName, int matrixSize)
+    {
+        if(!_parallel)
+        {
+            throw std::logic_error("only parallel loops split outputs");
+        }
+
+        for(const auto& partial : _partials)
+        {
+            if(partial.matrixName == matrixName)
+            {
+                return;
+            }
+        }
+        _partials.push_back({matrixName, matrixSize});
+    }
+
+    bool ForAllStatement::Shadows(const std::string& matrixName) const
+    {
+        auto hasName = [&](const MatrixCopy& copy) { return copy.matrixName == matrixName; };
+        return std::any_of(_replicas.begin(), _replicas.end(), hasName) || std::any_of(_partials.begin(), _partials.end(), hasName);
+    }
+
+    std::vector<std::string> ForAllStatement::GetReplicaNames() const
+    {
+        std::vector<std::string> names;
+        for(const auto& replica : _replicas)
+        {
+            names.push_back(replica.matrixName);
+        }
+        return names;
+    }
+
+    std::vector<std::string> ForAllStatement::GetPartialNames() const
+    {
+        std::vector<std::string> names;
+        for(const auto& partial : _partials)
+        {
+            names.push_back(partial.matrixName);
+        }
+        return names;
+    }
+
+    void ForAllStatement::AddPanelPrefetch(const std::string& matrixName, int matrixSize, int panelStride)
+    {
+        for(const auto& prefetch : _panelPrefetches)
+        {
+            if(prefetch.matrixName == matrixName)
+            {
+                return;
+            }
+        }
+        _panelPrefetches.push_back({matrixName, matrixSize, panelStride});
+    }
+
+    void ForAllStatement::AddInductionPointer(const std::string& name, const std::string& initialValue, int stride)
+    {
+        for(const auto& pointer : _inductionPointers)
+        {
+            if(pointer.name == name)
+            {
+                return;
+            }
+        }
+        _inductionPointers.push_back({name, initialValue, stride});
+    }
+
+    BlockForAllStatement::BlockForAllStatement(const Variable& indexVariable, std::shared_ptr<BlockSparseUsingStatement> matrixStatement, std::shared_ptr<ForAllStatement> rowStatement)
+        : ForAllStatement(indexVariable, 0, matrixStatement->GetLayout().NumColumns(), matrixStatement->GetBlockLayout().NumColumns()), _matrixStatement(matrixStatement), _rowStatement(rowStatement)
+    {
+        int blockRows = matrixStatement->GetBlockLayout().NumRows();
+        if(std::dynamic_pointer_cast<BlockForAllStatement>(rowStatement) != nullptr || rowStatement->GetStart() % blockRows != 0 || rowStatement->GetStep() % blockRows != 0)
+        {
+            throw std::logic_error("loop " + rowStatement->GetVariable().GetName() + " doesn't step through the block rows of " + matrixStatement->GetVariable().GetName());
+        }
+    }
+
+    void BlockForAllStatement::PrintForward(std::ostream& stream) const
+    {
+        auto name = GetVariable().GetName();
+        auto block = GetBlockName();
+        auto blockRow = _rowStatement->GetVariable().GetName() + " / " + std::to_string(_matrixStatement->GetBlockLayout().NumRows());
+
         stream << Indent;
-        PrintFormated(stream, "for(int % = %; % < %; % += %)    // ForAll statement, position:%\n", name, GetStart(), name, GetStop(), name, GetStep(), GetPosition());
+        PrintFormated(stream, "for(int % = %[%]; % < %[% + 1]; ++%)    // BlockForAll statement, matrix:%, position:%\n", block, _matrixStatement->GetRowStartsName(), blockRow, block, _matrixStatement->GetRowStartsName(), blockRow, block, _matrixStatement->GetVariable().GetName(), GetPosition());
         stream << Indent << "{\n";
         IncreaseIndent();
+        stream << Indent;
+        PrintFormated(stream, "const int % = %[%];\n", name, _matrixStatement->GetBlockColumnsName(), block);
     }
 
-    void ForAllStatement::PrintBackward(std::ostream& stream) const
+    // Prints a warning if the leading dimension of a matrix crowds its rows into a few cache sets
+    void PrintConflictWarning(std::ostream& stream, const MatrixStatement& statement)
     {
-        DecreaseIndent();
-        stream << Indent << "}\n";
+        const auto& layout = statement.GetLayout();
+        if(IsConflictProne(layout))
+        {
+            stream << Indent;
+            PrintFormated(stream, "// warning: the leading dimension % of % causes cache conflicts, % would avoid them (see UsingPadded)\n", layout.GetLeadingDimensionSize(), statement.GetVariable().GetName(), GetPaddedLeadingDimensionSize(layout.GetLeadingDimensionSize(), layout.GetMajorSize()));
+        }
     }
 
     UsingStatement::UsingStatement(const Variable& matrixVariable, MatrixLayout matrixLayout, bool isOutput, float* data) : MatrixStatement(matrixVariable, matrixLayout, isOutput), _data(data)
@@ -58,94 +262,467 @@ namespace tiler
         auto name = GetVariable().GetName();
         auto layout = GetLayout();
         stream << Indent;
-        PrintFormated(stream, "float %[%]", name, GetLayout().Size());
+        PrintFormated(stream, "alignas(64) float %[%]", name, GetLayout().Size());
 
         if(_data != nullptr)
         {
             stream << " = {" << *_data;
-            for(int i=1; i<GetLayout().Size(); ++i)
+            for(int i=1; i<GetLayout().GetDataSize(); ++i)
             {
                 stream << ", " << _data[i];
             }
             stream << "}";
         }
 
-        PrintFormated(stream, ";    // Using statement, rows:%, cols:%, order:%, output:%\n", layout.NumRows(), layout.NumColumns(), (layout.GetOrder() == MatrixOrder::rowMajor) ? "row" : "column", IsOutput() ? "true" : "false");
+        PrintFormated(stream, ";    // Using statement, rows:%, cols:%, order:%, output:%\n", layout.NumRows(), layout.NumColumns(), GetOrderName(layout.GetOrder()), IsOutput() ? "true" : "false");
+        PrintConflictWarning(stream, *this);
     }
 
-    TileStatement::TileStatement(const Variable& tileVariable, MatrixLayout tileLayout, MatrixStatementPtr matrixStatement, StatementPtr topStatement, StatementPtr leftStatement)
-        : MatrixStatement(tileVariable, tileLayout, matrixStatement->IsOutput()), _matrixStatement(matrixStatement), _topStatement(topStatement), _leftStatement(leftStatement)
+    PaddedUsingStatement::PaddedUsingStatement(const Variable& matrixVariable, MatrixLayout matrixLayout, float* data) : UsingStatement(matrixVariable, GetPaddedLayout(matrixLayout), false, data), _dataLayout(matrixLayout)
     {}
 
-    void TileStatement::PrintForward(std::ostream& stream) const
+    void PaddedUsingStatement::PrintForward(std::ostream& stream) const
     {
         auto name = GetVariable().GetName();
-        auto matrixLayout = _matrixStatement->GetLayout();
-        auto tileLayout = GetLayout();
+        auto layout = GetLayout();
 
-        // construct string that represents the source location in memory
-        std::string source = _matrixStatement->GetVariable().GetName() + " + " + _topStatement->GetVariable().GetName();
+        stream << Indent;
+        PrintFormated(stream, "alignas(64) float %[%]", name, layout.Size());
 
-        if(matrixLayout.GetOrder() == MatrixOrder::rowMajor)
+        // the padding is zero
+        if(GetData() != nullptr)
         {
-            source +=  " * " + std::to_string(matrixLayout.GetLeadingDimensionSize()) + " + " + _leftStatement->GetVariable().GetName();
+            std::vector<float> values(layout.Size());
+            ConvertLayout(GetData(), _dataLayout, values.data(), layout);
+            stream << " = {" << values[0];
+            for(int i=1; i<layout.Size(); ++i)
+            {
+                stream << ", " << values[i];
+            }
+            stream << "}";
         }
-        else
+
+        PrintFormated(stream, ";    // Padded using statement, rows:%, cols:%, order:%, leading dimension:% (padded from %)\n", layout.NumRows(), layout.NumColumns(), GetOrderName(layout.GetOrder()), layout.GetLeadingDimensionSize(), _dataLayout.GetLeadingDimensionSize());
+    }
+
+    // Escapes a string for a C++ string literal, so a path prints as itself
+    std::string EscapeStringLiteral(const std::string& text)
+    {
+        std::string escaped;
+        for(char character : text)
         {
-            source += _leftStatement->GetVariable().GetName() + " * " + std::to_string(matrixLayout.GetLeadingDimensionSize());
+            if(character == '"' || character == '\\')
+            {
+                escaped += '\\';
+                escaped += character;
+            }
+            else if(character == '\n')
+            {
+                escaped += "\\n";
+            }
+            else
+            {
+                escaped += character;
+            }
         }
+        return escaped;
+    }
+
+    MappedUsingStatement::MappedUsingStatement(const Variable& matrixVariable, MatrixLayout matrixLayout, bool isOutput, std::string path) : UsingStatement(matrixVariable, matrixLayout, isOutput, nullptr), _path(path)
+    {}
+
+    void MappedUsingStatement::PrintForward(std::ostream& stream) const
+    {
+        auto name = GetVariable().GetName();
+        auto layout = GetLayout();
+        stream << Indent;
+        PrintFormated(stream, "float* % = (float*)__builtin_assume_aligned(MapMatrix(\"%\", %, %), 64);", name, EscapeStringLiteral(_path), layout.GetDataSize(), IsOutput() ? "true" : "false");
+        PrintFormated(stream, "    // Mapped using statement, rows:%, cols:%, order:%, output:%\n", layout.NumRows(), layout.NumColumns(), GetOrderName(layout.GetOrder()), IsOutput() ? "true" : "false");
+        stream << Indent;
+        PrintFormated(stream, "if(% == nullptr)\n", name);
+        stream << Indent << "{\n" << Indent << "    return 1;\n" << Indent << "}\n";
+        PrintConflictWarning(stream, *this);
+    }
 
+    void MappedUsingStatement::PrintBackward(std::ostream& stream) const
+    {
         stream << Indent;
+        PrintFormated(stream, "UnmapMatrix(%, %);\n", GetVariable().GetName(), GetLayout().GetDataSize());
+    }
 
-        if(IsCached())
-        { 
-            if(tileLayout.GetOrder() == matrixLayout.GetOrder())
+    BlockSparseUsingStatement::BlockSparseUsingStatement(const Variable& matrixVariable, MatrixLayout matrixLayout, int blockRows, int blockColumns, float* data)
+        : UsingStatement(matrixVariable, matrixLayout, false, data), _blockRows(blockRows), _blockColumns(blockColumns)
+    {
+        auto name = matrixVariable.GetName();
+        if(matrixLayout.IsBlocked())
+        {
+            throw std::logic_error("block-sparse matrix " + name + " must be row-major or column-major");
+        }
+
+        if(blockRows < 1 || blockColumns < 1 || matrixLayout.NumRows() % blockRows != 0 || matrixLayout.NumColumns() % blockColumns != 0)
+        {
+            throw std::logic_error("blocks of block-sparse matrix " + name + " don't divide it");
+        }
+
+        if(data == nullptr)
+        {
+            throw std::logic_error("block-sparse matrix " + name + " requires data");
+        }
+
+        // pack the nonzero blocks of each block row
+        auto blockLayout = GetBlockLayout();
+        for(int top = 0; top < matrixLayout.NumRows(); top += blockRows)
+        {
+            _rowStarts.push_back(NumNonzeroBlocks());
+            for(int left = 0; left < matrixLayout.NumColumns(); left += blockColumns)
             {
-                PrintFormated(stream, "Copy(%, %, %, %, %, %);", name, source, tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), tileLayout.GetLeadingDimensionSize(), matrixLayout.GetLeadingDimensionSize());
+                std::vector<float> block(blockLayout.Size());
+                bool isNonzero = false;
+                for(int i = 0; i < blockRows; ++i)
+                {
+                    for(int j = 0; j < blockColumns; ++j)
+                    {
+                        block[blockLayout(i, j)] = data[matrixLayout(top + i, left + j)];
+                        isNonzero = isNonzero || block[blockLayout(i, j)] != 0;
+                    }
+                }
+
+                if(isNonzero)
+                {
+                    _blockLefts.push_back(left);
+                    _blocks.insert(_blocks.end(), block.begin(), block.end());
+                }
+            }
+        }
+        _rowStarts.push_back(NumNonzeroBlocks());
+    }
+
+    // Prints the elements of an array initializer, an empty array gets a single zero
+    template<typename ElementType>
+    void PrintInitializer(std::ostream& stream, const std::vector<ElementType>& values)
+    {
+        stream << "{" << (values.empty() ? 0 : values[0]);
+        for(size_t i = 1; i < values.size(); ++i)
+        {
+            stream << ", " << values[i];
+        }
+        stream << "}";
+    }
+
+    void BlockSparseUsingStatement::PrintForward(std::ostream& stream) const
+    {
+        auto name = GetVariable().GetName();
+        auto layout = GetLayout();
+        int numBlocks = (layout.NumRows() / _blockRows) * (layout.NumColumns() / _blockColumns);
+
+        stream << Indent;
+        PrintFormated(stream, "alignas(64) float %[%] = ", name, std::max(GetStorageSize(), 1));
+        PrintInitializer(stream, _blocks);
+        PrintFormated(stream, ";    // Block-sparse using statement, rows:%, cols:%, order:%, blocks:%x%, nonzero blocks:% of %\n", layout.NumRows(), layout.NumColumns(), GetOrderName(layout.GetOrder()), _blockRows, _blockColumns, NumNonzeroBlocks(), numBlocks);
+        stream << Indent;
+        PrintFormated(stream, "const int %[%] = ", GetRowStartsName(), _rowStarts.size());
+        PrintInitializer(stream, _rowStarts);
+        stream << ";\n" << Indent;
+        PrintFormated(stream, "const int %[%] = ", GetBlockColumnsName(), std::max(NumNonzeroBlocks(), 1));
+        PrintInitializer(stream, _blockLefts);
+        stream << ";\n";
+    }
+
+    MatrixLayout BlockSparseUsingStatement::GetBlockLayout() const
+    {
+        return MatrixLayout(_blockRows, _blockColumns, GetLayout().GetOrder());
+    }
+
+    CombinationUsingStatement::CombinationUsingStatement(const Variable& matrixVariable, MatrixLayout matrixLayout, bool isOutput, const Variable& parentVariable, std::vector<Term> terms)
+        : UsingStatement(matrixVariable, matrixLayout, isOutput, nullptr), _parentVariable(parentVariable), _terms(terms), _parentLeadingDimensionSize(matrixLayout.GetLeadingDimensionSize())
+    {
+        if(_terms.empty())
+        {
+            throw std::logic_error("combination " + matrixVariable.GetName() + " has no terms");
+        }
+
+        if(matrixLayout.IsBlocked())
+        {
+            throw std::logic_error("combination " + matrixVariable.GetName() + " must be row-major or column-major");
+        }
+    }
+
+    void CombinationUsingStatement::PrintForward(std::ostream& stream) const
+    {
+        auto name = GetVariable().GetName();
+        auto layout = GetLayout();
+
+        if(!IsView())
+        {
+            stream << Indent << "const int " << GetOffsetsName() << "[] = {0";
+            for(int i = 1; i < NumTerms(); ++i)
+            {
+                stream << ", " << _terms[i].offset - _terms[0].offset;
+            }
+            stream << "};\n" << Indent << "const float " << GetCoefficientsName() << "[] = {" << _terms[0].coefficient;
+            for(int i = 1; i < NumTerms(); ++i)
+            {
+                stream << ", " << _terms[i].coefficient;
+            }
+            stream << "};\n";
+        }
+
+        stream << Indent;
+        PrintFormated(stream, "float* % = %;", name, IsMaterialized() ? _workspaceName : GetFirstTermExpression());
+        PrintFormated(stream, "    // Combination using statement, rows:%, cols:%, order:%, output:%, terms:%\n", layout.NumRows(), layout.NumColumns(), GetOrderName(layout.GetOrder()), IsOutput() ? "true" : "false", NumTerms());
+
+        if(IsMaterialized())
+        {
+            stream << Indent;
+            if(IsOutput())
+            {
+                PrintFormated(stream, "std::fill_n(%, %, 0.0f);\n", name, layout.Size());
             }
             else
             {
-                PrintFormated(stream, "CopyTranspose(%, %, %, %, %, %);", name, source, tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), tileLayout.GetLeadingDimensionSize(), matrixLayout.GetLeadingDimensionSize());
+                PrintFormated(stream, "CopyCombination(%, %, %, %, %, %, %, %, %, 1);\n", name, GetFirstTermExpression(), GetOffsetsName(), GetCoefficientsName(), NumTerms(), layout.GetMinorSize(), layout.GetMajorSize(), layout.GetLeadingDimensionSize(), _parentLeadingDimensionSize);
             }
         }
+    }
+
+    void CombinationUsingStatement::PrintBackward(std::ostream& stream) const
+    {
+        if(IsMaterialized() && IsOutput())
+        {
+            auto layout = GetLayout();
+            stream << Indent;
+            PrintFormated(stream, "AddCombination(%, %, %, %, %, %, %, %, 1, %);    // add workspace to the parent\n", GetFirstTermExpression(), GetVariable().GetName(), GetOffsetsName(), GetCoefficientsName(), NumTerms(), layout.GetMinorSize(), layout.GetMajorSize(), _parentLeadingDimensionSize, layout.GetLeadingDimensionSize());
+        }
+    }
+
+    bool CombinationUsingStatement::IsView() const
+    {
+        return NumTerms() == 1 && _terms[0].coefficient == 1.0f;
+    }
+
+    void CombinationUsingStatement::Materialize(const std::string& workspaceName)
+    {
+        auto layout = GetLayout();
+        GetLayout() = MatrixLayout(layout.NumRows(), layout.NumColumns(), layout.GetOrder());
+        _workspaceName = workspaceName;
+    }
+
+    std::string CombinationUsingStatement::GetFirstTermExpression() const
+    {
+        return _parentVariable.GetName() + " + " + std::to_string(_terms[0].offset);
+    }
+
+    // Returns an expression that computes the offset of element (row, column) in a matrix
+    std::string GetOffsetExpression(const MatrixLayout& layout, const std::string& row, const std::string& column)
+    {
+        auto leadingDimensionSize = layout.GetLeadingDimensionSize();
+        auto blockSize = layout.GetBlockSize();
+        auto offsetInBlock = "(" + row + " % " + std::to_string(blockSize) + ") * " + std::to_string(blockSize) + " + " + column + " % " + std::to_string(blockSize);
+
+        switch(layout.GetOrder())
+        {
+            case MatrixOrder::rowMajor:
+                return row + " * " + std::to_string(leadingDimensionSize) + " + " + column;
+
+            case MatrixOrder::columnMajor:
+                return row + " + " + column + " * " + std::to_string(leadingDimensionSize);
+
+            case MatrixOrder::blocked:
+                return "(" + row + " / " + std::to_string(blockSize) + ") * " + std::to_string(leadingDimensionSize * blockSize) + " + (" + column + " / " + std::to_string(blockSize) + ") * " + std::to_string(blockSize * blockSize) + " + " + offsetInBlock;
+
+            default:
+                return "MortonIndex(" + row + " / " + std::to_string(blockSize) + ", " + column + " / " + std::to_string(blockSize) + ") * " + std::to_string(blockSize * blockSize) + " + " + offsetInBlock;
+        }
+    }
+
+    TileStatement::TileStatement(const Variable& tileVariable, MatrixLayout tileLayout, MatrixStatementPtr matrixStatement, StatementPtr topStatement, StatementPtr leftStatement)
+        : MatrixStatement(tileVariable, tileLayout, matrixStatement->IsOutput()), _matrixStatement(matrixStatement), _topStatement(topStatement), _leftStatement(leftStatement)
+    {}
+
+    void TileStatement::PrintForward(std::ostream& stream) const
+    {
+        auto name = GetVariable().GetName();
+        auto tileLayout = GetLayout();
+
+        stream << Indent;
+
+        if(IsShared())
+        {
+            PrintSharedCopy(stream);
+        }
+        else if(IsCached())
+        { 
+            PrintCopy(stream, false);
+        }
         else
         {
-            PrintFormated(stream, "float* % = %;", name, source);
+            auto combination = std::dynamic_pointer_cast<CombinationUsingStatement>(_matrixStatement);
+            if(combination != nullptr && combination->IsFused())
+            {
+                throw std::logic_error("tile " + name + " of combination " + combination->GetVariable().GetName() + " must be cached");
+            }
+
+            PrintFormated(stream, "float* __restrict__ % = %;", name, GetSourceExpression());
         }
 
-        PrintFormated(stream, "    // Tile statement, rows:%, columns:%, order:%, cached:%\n", tileLayout.NumRows(), tileLayout.NumColumns(), (tileLayout.GetOrder() == MatrixOrder::rowMajor) ? "row" : "column", IsCached() ? "true" : "false");
+        PrintFormated(stream, "    // Tile statement, rows:%, columns:%, order:%, cached:%\n", tileLayout.NumRows(), tileLayout.NumColumns(), GetOrderName(tileLayout.GetOrder()), IsShared() ? "shared" : IsCached() ? "true" : "false");
+
+        if(IsShared())
+        {
+            stream << Indent << "ParallelBarrier();    // wait until the shared cache is packed\n";
+        }
     }
 
     void TileStatement::PrintBackward(std::ostream& stream) const
     {
         if(IsCached() && IsOutput())
         { 
-            auto name = GetVariable().GetName();
-            auto matrixLayout = _matrixStatement->GetLayout();
-            auto tileLayout = GetLayout();
+            stream << Indent;
+            PrintCopy(stream, true);
+            stream << "    // copy output value back from cache\n";
+        }
+    }
+
+    bool TileStatement::RequiresIndexedCopy() const
+    {
+        return IsCached() && (GetLayout().IsBlocked() || _matrixStatement->GetLayout().IsBlocked());
+    }
+
+    void TileStatement::PrintOffsetTables(std::ostream& stream) const
+    {
+        auto name = GetVariable().GetName();
+        auto tileLayout = GetLayout();
+        auto matrixLayout = GetSourceLayout();
+
+        // offsets of the tile elements in the cache and in the original matrix, relative to the tile origin
+        std::string tileOffsets;
+        std::string matrixOffsets;
+        for(int i = 0; i < tileLayout.NumRows(); ++i)
+        {
+            for(int j = 0; j < tileLayout.NumColumns(); ++j)
+            {
+                std::string separator = (i == 0 && j == 0) ? "" : ", ";
+                tileOffsets += separator + std::to_string(tileLayout(i, j));
+                matrixOffsets += separator + std::to_string(matrixLayout(i, j));
+            }
+        }
+
+        stream << Indent;
+        PrintFormated(stream, "const int %_tileOffsets[] = {%};\n", name, tileOffsets);
+        stream << Indent;
+        PrintFormated(stream, "const int %_matrixOffsets[] = {%};\n", name, matrixOffsets);
+    }
+
+    std::string TileStatement::GetSourceExpression() const
+    {
+        if(!_sourcePointer.empty())
+        {
+            return _sourcePointer;
+        }
+
+        // a tile of a block-sparse matrix is the packed block at the counter of its BlockForAll loop
+        auto blockLoop = std::dynamic_pointer_cast<BlockForAllStatement>(_leftStatement);
+        if(blockLoop != nullptr && blockLoop->GetMatrixStatement() == _matrixStatement)
+        {
+            return _matrixStatement->GetVariable().GetName() + " + " + blockLoop->GetBlockName() + " * " + std::to_string(GetLayout().Size());
+        }
 
-            std::string source = _matrixStatement->GetVariable().GetName() + " + " + _topStatement->GetVariable().GetName();
+        return _matrixStatement->GetVariable().GetName() + " + " + GetOffsetExpression(_matrixStatement->GetLayout(), _topStatement->GetVariable().GetName(), _leftStatement->GetVariable().GetName());
+    }
+
+    MatrixLayout TileStatement::GetSourceLayout() const
+    {
+        auto sparseStatement = std::dynamic_pointer_cast<BlockSparseUsingStatement>(_matrixStatement);
+        return sparseStatement != nullptr ? sparseStatement->GetBlockLayout() : _matrixStatement->GetLayout();
+    }
+
+    void TileStatement::PrintCopy(std::ostream& stream, bool copyBack) const
+    {
+        auto name = GetVariable().GetName();
+        auto source = GetSourceExpression();
+        auto matrixLayout = GetSourceLayout();
+        auto tileLayout = GetLayout();
 
-            if(matrixLayout.GetOrder() == MatrixOrder::rowMajor)
+        // tiles of combinations sum the terms when they are packed, output tiles start at zero and are added to every term
+        auto combination = std::dynamic_pointer_cast<CombinationUsingStatement>(_matrixStatement);
+        if(combination != nullptr && combination->IsFused())
+        {
+            int skip = IsTransposed() ? 1 : matrixLayout.GetLeadingDimensionSize();
+            int step = IsTransposed() ? matrixLayout.GetLeadingDimensionSize() : 1;
+            if(copyBack)
+            {
+                PrintFormated(stream, "AddCombination(%, %, %, %, %, %, %, %, %, %);", source, name, combination->GetOffsetsName(), combination->GetCoefficientsName(), combination->NumTerms(), tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), skip, step, tileLayout.GetLeadingDimensionSize());
+            }
+            else if(IsOutput())
             {
-                source +=  " * " + std::to_string(matrixLayout.GetLeadingDimensionSize()) + " + " + _leftStatement->GetVariable().GetName();
+                PrintFormated(stream, "std::fill_n(%, %, 0.0f);", name, tileLayout.Size());
             }
             else
             {
-                source += _leftStatement->GetVariable().GetName() + " * " + std::to_string(matrixLayout.GetLeadingDimensionSize());
+                PrintFormated(stream, "CopyCombination(%, %, %, %, %, %, %, %, %, %);", name, source, combination->GetOffsetsName(), combination->GetCoefficientsName(), combination->NumTerms(), tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), tileLayout.GetLeadingDimensionSize(), skip, step);
             }
+            return;
+        }
 
-            stream << Indent;
-
-            if(tileLayout.GetOrder() == matrixLayout.GetOrder())
+        if(RequiresIndexedCopy())
+        {
+            if(copyBack)
+            {
+                PrintFormated(stream, "CopyIndexed(%, %, %_matrixOffsets, %_tileOffsets, %);", source, name, name, name, tileLayout.Size());
+            }
+            else
+            {
+                PrintFormated(stream, "CopyIndexed(%, %, %_tileOffsets, %_matrixOffsets, %);", name, source, name, name, tileLayout.Size());
+            }
+        }
+        else if(!IsTransposed())
+        {
+            if(copyBack)
             {
                 PrintFormated(stream, "Copy(%, %, %, %, %, %);", source, name, tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), matrixLayout.GetLeadingDimensionSize(), tileLayout.GetLeadingDimensionSize());
             }
             else
             {
-                PrintFormated(stream, "CopyTranspose(%, %, %, %, %, %);", source, name, tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), matrixLayout.GetLeadingDimensionSize(), tileLayout.GetLeadingDimensionSize());
+                PrintFormated(stream, "Copy(%, %, %, %, %, %);", name, source, tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), tileLayout.GetLeadingDimensionSize(), matrixLayout.GetLeadingDimensionSize());
             }
-            stream << "    // copy output value back from cache\n";
+        }
+        else
+        {
+            // the major dimension of the tile is the minor dimension of the matrix
+            if(copyBack)
+            {
+                PrintFormated(stream, "CopyTranspose(%, %, %, %, %, %);", source, name, tileLayout.GetMajorSize(), tileLayout.GetMinorSize(), matrixLayout.GetLeadingDimensionSize(), tileLayout.GetLeadingDimensionSize());
+            }
+            else
+            {
+                PrintFormated(stream, "CopyTranspose(%, %, %, %, %, %);", name, source, tileLayout.GetMinorSize(), tileLayout.GetMajorSize(), tileLayout.GetLeadingDimensionSize(), matrixLayout.GetLeadingDimensionSize());
+            }
+        }
+    }
+
+    void TileStatement::PrintSharedCopy(std::ostream& stream) const
+    {
+        auto name = GetVariable().GetName();
+        auto matrixLayout = GetSourceLayout();
+        auto tileLayout = GetLayout();
+        int majorSize = tileLayout.GetMajorSize();
+        int tileStride = tileLayout.GetLeadingDimensionSize();
+        int matrixStride = matrixLayout.GetLeadingDimensionSize();
+
+        // each thread packs a contiguous range of the major vectors of the tile, once the team is done with the previous contents
+        stream << "ParallelBarrier();    // wait until the team is done with the shared cache\n";
+        stream << Indent;
+        PrintFormated(stream, "const int %_first = % * parallelThread / parallelNumThreads;\n", name, majorSize);
+        stream << Indent;
+        PrintFormated(stream, "const int %_last = % * (parallelThread + 1) / parallelNumThreads;\n", name, majorSize);
+        stream << Indent;
+        if(!IsTransposed())
+        {
+            PrintFormated(stream, "Copy(% + %_first * %, % + %_first * %, %, %_last - %_first, %, %);", name, name, tileStride, GetSourceExpression(), name, matrixStride, tileLayout.GetMinorSize(), name, name, tileStride, matrixStride);
+        }
+        else
+        {
+            PrintFormated(stream, "CopyTranspose(% + %_first * %, % + %_first, %, %_last - %_first, %, %);", name, name, tileStride, GetSourceExpression(), name, tileLayout.GetMinorSize(), name, name, tileStride, matrixStride);
         }
     }
 
@@ -155,6 +732,24 @@ namespace tiler
         SetPosition(position);
     }
 
+    ScratchStatement::ScratchStatement(const Variable& scratchVariable, MatrixLayout scratchLayout, StatementPtr topStatement, StatementPtr leftStatement)
+        : MatrixStatement(scratchVariable, scratchLayout, true), _topStatement(topStatement), _leftStatement(leftStatement)
+    {}
+
+    void ScratchStatement::PrintForward(std::ostream& stream) const
+    {
+        auto layout = GetLayout();
+        stream << Indent;
+        PrintFormated(stream, "std::fill_n(%, %, 0.0f);", GetVariable().GetName(), layout.Size());
+        PrintFormated(stream, "    // Scratch statement, rows:%, columns:%, order:%\n", layout.NumRows(), layout.NumColumns(), GetOrderName(layout.GetOrder()));
+    }
+
+    void ScratchStatement::SetPositionByDependencies()
+    {
+        double position = std::max(_topStatement->GetPosition(), _leftStatement->GetPosition());
+        SetPosition(position);
+    }
+
     KernelStatement::KernelStatement(MatrixStatementPtr matrixAStatement, MatrixStatementPtr matrixBStatement, MatrixStatementPtr matrixCStatement, KernelType kernel) 
         : StatementBase(Variable()), _matrixAStatement(matrixAStatement), _matrixBStatement(matrixBStatement), _matrixCStatement(matrixCStatement), _kernel(kernel)
     {}
@@ -164,4 +759,297 @@ namespace tiler
         _kernel(stream, *_matrixAStatement, *_matrixBStatement, *_matrixCStatement);
     }
 
+    RecursiveKernelStatement::RecursiveKernelStatement(MatrixStatementPtr matrixAStatement, MatrixStatementPtr matrixBStatement, MatrixStatementPtr matrixCStatement, KernelType kernel, int baseM, int baseN, int baseK)
+        : KernelStatement(matrixAStatement, matrixBStatement, matrixCStatement, kernel), _baseM(baseM), _baseN(baseN), _baseK(baseK)
+    {
+        auto a = matrixAStatement->GetLayout();
+        auto b = matrixBStatement->GetLayout();
+        auto c = matrixCStatement->GetLayout();
+
+        if(a.IsBlocked() || b.IsBlocked() || c.IsBlocked())
+        {
+            throw std::logic_error("recursive kernels require row-major or column-major operands");
+        }
+
+        if(a.NumRows() != c.NumRows() || b.NumColumns() != c.NumColumns() || a.NumColumns() != b.NumRows())
+        {
+            throw std::logic_error("operands of recursive kernel have incompatible sizes");
+        }
+
+        if(c.NumRows() % baseM != 0 || c.NumColumns() % baseN != 0 || a.NumColumns() % baseK != 0)
+        {
+            throw std::logic_error("operands of recursive kernel are not multiples of the base case size");
+        }
+
+        if(matrixAStatement->GetVariable() == matrixBStatement->GetVariable() || matrixAStatement->GetVariable() == matrixCStatement->GetVariable() || matrixBStatement->GetVariable() == matrixCStatement->GetVariable())
+        {
+            throw std::logic_error("operands of recursive kernel must be distinct");
+        }
+    }
+
+    void RecursiveKernelStatement::PrintForward(std::ostream& stream) const
+    {
+        stream << Indent;
+        PrintFormated(stream, "%(%, %, %);    // Recursive kernel statement, base:%x%x%\n", GetFunctionName(-1), GetMatrixAStatement()->GetVariable().GetName(), GetMatrixBStatement()->GetVariable().GetName(), GetMatrixCStatement()->GetVariable().GetName(), _baseM, _baseN, _baseK);
+    }
+
+    void RecursiveKernelStatement::PrintFunctions(std::ostream& stream) const
+    {
+        auto a = GetMatrixAStatement()->GetLayout();
+        auto b = GetMatrixBStatement()->GetLayout();
+        auto c = GetMatrixCStatement()->GetLayout();
+
+        // heap caches are allocated with aligned_alloc
+        for(const auto& directive : _cacheDirectives)
+        {
+            MatrixStatementPtr operands[] = { GetMatrixAStatement(), GetMatrixBStatement(), GetMatrixCStatement() };
+            auto layout = operands[directive.operand]->GetLayout();
+            if(IsHeapCache(GetPaddedLayout(MatrixLayout(layout.NumRows(), layout.NumColumns(), directive.order))))
+            {
+                stream << Indent << "#include <stdlib.h>\n\n";
+                break;
+            }
+        }
+
+        std::vector<std::string> signatures;
+        PrintRecursion(stream, signatures, c.NumRows(), c.NumColumns(), a.NumColumns(), a, b, c, 0);
+    }
+
+    void RecursiveKernelStatement::AddCache(const Variable& matrixVariable, int depth, MatrixOrder order)
+    {
+        if(order != MatrixOrder::rowMajor && order != MatrixOrder::columnMajor)
+        {
+            throw std::logic_error("recursive kernels cache operands in row-major or column-major order");
+        }
+
+        MatrixStatementPtr operands[] = { GetMatrixAStatement(), GetMatrixBStatement(), GetMatrixCStatement() };
+        for(int operand = 0; operand < 3; ++operand)
+        {
+            if(operands[operand]->GetVariable() == matrixVariable)
+            {
+                _cacheDirectives.push_back({operand, depth, order});
+                return;
+            }
+        }
+
+        throw std::logic_error("variable " + matrixVariable.GetName() + " is not an operand of the recursive kernel");
+    }
+
+    bool RecursiveKernelStatement::RequiresCopy() const
+    {
+        MatrixStatementPtr operands[] = { GetMatrixAStatement(), GetMatrixBStatement(), GetMatrixCStatement() };
+        for(const auto& directive : _cacheDirectives)
+        {
+            if(operands[directive.operand]->GetLayout().GetOrder() == directive.order)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RecursiveKernelStatement::RequiresCopyTranspose() const
+    {
+        MatrixStatementPtr operands[] = { GetMatrixAStatement(), GetMatrixBStatement(), GetMatrixCStatement() };
+        for(const auto& directive : _cacheDirectives)
+        {
+            if(operands[directive.operand]->GetLayout().GetOrder() != directive.order)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string RecursiveKernelStatement::PrintRecursion(std::ostream& stream, std::vector<std::string>& signatures, int m, int n, int k, MatrixLayout a, MatrixLayout b, MatrixLayout c, int depth) const
+    {
+        MatrixStatementPtr operands[] = { GetMatrixAStatement(), GetMatrixBStatement(), GetMatrixCStatement() };
+        std::string names[] = { operands[0]->GetVariable().GetName(), operands[1]->GetVariable().GetName(), operands[2]->GetVariable().GetName() };
+        MatrixLayout sourceLayouts[] = { a, b, c };
+        MatrixLayout layouts[] = { a, b, c };
+        bool isCached[] = { false, false, false };
+
+        // apply the cache directives of this depth
+        for(const auto& directive : _cacheDirectives)
+        {
+            if(directive.depth == depth)
+            {
+                auto& layout = layouts[directive.operand];
+                layout = GetPaddedLayout(MatrixLayout(layout.NumRows(), layout.NumColumns(), directive.order));
+                isCached[directive.operand] = true;
+            }
+        }
+
+        // functions are shared by all the calls with the same shape, layouts, and depth
+        std::string signature = std::to_string(m) + "," + std::to_string(n) + "," + std::to_string(k) + "," + std::to_string(depth);
+        for(const auto& layout : layouts)
+        {
+            signature += "," + GetOrderName(layout.GetOrder()) + "," + std::to_string(layout.GetLeadingDimensionSize());
+        }
+
+        for(int index = 0; index < (int)signatures.size(); ++index)
+        {
+            if(signatures[index] == signature)
+            {
+                return GetFunctionName(index);
+            }
+        }
+
+        std::vector<std::string> calls;
+        auto subLayout = [](const MatrixLayout& layout, int numRows, int numColumns) { return MatrixLayout(numRows, numColumns, layout.GetOrder(), layout.GetLeadingDimensionSize()); };
+        const auto& la = layouts[0];
+        const auto& lb = layouts[1];
+        const auto& lc = layouts[2];
+
+        int firstSize = 0;
+        int split = GetSplit(m, n, k, firstSize);
+        if(split == 0)
+        {
+            int m1 = firstSize;
+            auto first = PrintRecursion(stream, signatures, m1, n, k, subLayout(la, m1, k), subLayout(lb, k, n), subLayout(lc, m1, n), depth + 1);
+            auto second = PrintRecursion(stream, signatures, m - m1, n, k, subLayout(la, m - m1, k), subLayout(lb, k, n), subLayout(lc, m - m1, n), depth + 1);
+            calls.push_back(first + "(" + names[0] + ", " + names[1] + ", " + names[2] + ");");
+            calls.push_back(second + "(" + names[0] + " + " + std::to_string(la(m1, 0)) + ", " + names[1] + ", " + names[2] + " + " + std::to_string(lc(m1, 0)) + ");");
+        }
+        else if(split == 1)
+        {
+            int n1 = firstSize;
+            auto first = PrintRecursion(stream, signatures, m, n1, k, subLayout(la, m, k), subLayout(lb, k, n1), subLayout(lc, m, n1), depth + 1);
+            auto second = PrintRecursion(stream, signatures, m, n - n1, k, subLayout(la, m, k), subLayout(lb, k, n - n1), subLayout(lc, m, n - n1), depth + 1);
+            calls.push_back(first + "(" + names[0] + ", " + names[1] + ", " + names[2] + ");");
+            calls.push_back(second + "(" + names[0] + ", " + names[1] + " + " + std::to_string(lb(0, n1)) + ", " + names[2] + " + " + std::to_string(lc(0, n1)) + ");");
+        }
+        else if(split == 2)
+        {
+            int k1 = firstSize;
+            auto first = PrintRecursion(stream, signatures, m, n, k1, subLayout(la, m, k1), subLayout(lb, k1, n), subLayout(lc, m, n), depth + 1);
+            auto second = PrintRecursion(stream, signatures, m, n, k - k1, subLayout(la, m, k - k1), subLayout(lb, k - k1, n), subLayout(lc, m, n), depth + 1);
+            calls.push_back(first + "(" + names[0] + ", " + names[1] + ", " + names[2] + ");");
+            calls.push_back(second + "(" + names[0] + " + " + std::to_string(la(0, k1)) + ", " + names[1] + " + " + std::to_string(lb(k1, 0)) + ", " + names[2] + ");");
+        }
+
+        // print the function
+        auto functionName = (depth == 0) ? GetFunctionName(-1) : GetFunctionName((int)signatures.size());
+        signatures.push_back(signature);
+
+        stream << Indent;
+        PrintFormated(stream, "void %(float* __restrict__ %, float* __restrict__ %, float* __restrict__ %)    // recursion depth:%, size:%x%x%\n", functionName, names[0], names[1], names[2], depth, m, n, k);
+        stream << Indent << "{\n";
+        IncreaseIndent();
+
+        for(int operand = 0; operand < 3; ++operand)
+        {
+            if(!isCached[operand])
+            {
+                continue;
+            }
+
+            const auto& name = names[operand];
+            const auto& source = sourceLayouts[operand];
+            const auto& cache = layouts[operand];
+            stream << Indent;
+            PrintFormated(stream, "float* %_source = %;\n", name, name);
+            stream << Indent;
+            if(IsHeapCache(cache))
+            {
+                PrintFormated(stream, "float* %_cache = (float*)aligned_alloc(64, %);\n", name, (cache.Size() * sizeof(float) + 63) / 64 * 64);
+            }
+            else
+            {
+                PrintFormated(stream, "alignas(64) float %_cache[%];\n", name, cache.Size());
+            }
+            stream << Indent;
+            if(source.GetOrder() == cache.GetOrder())
+            {
+                PrintFormated(stream, "Copy(%_cache, %_source, %, %, %, %);\n", name, name, cache.GetMinorSize(), cache.GetMajorSize(), cache.GetLeadingDimensionSize(), source.GetLeadingDimensionSize());
+            }
+            else
+            {
+                PrintFormated(stream, "CopyTranspose(%_cache, %_source, %, %, %, %);\n", name, name, cache.GetMinorSize(), cache.GetMajorSize(), cache.GetLeadingDimensionSize(), source.GetLeadingDimensionSize());
+            }
+            stream << Indent;
+            PrintFormated(stream, "% = (float*)__builtin_assume_aligned(%_cache, 64);\n", name, name);
+        }
+
+        if(calls.empty())
+        {
+            // base case
+            UsingStatement matrixA(operands[0]->GetVariable(), la, false, nullptr);
+            UsingStatement matrixB(operands[1]->GetVariable(), lb, false, nullptr);
+            UsingStatement matrixC(operands[2]->GetVariable(), lc, true, nullptr);
+            GetKernel()(stream, matrixA, matrixB, matrixC);
+        }
+
+        for(const auto& call : calls)
+        {
+            stream << Indent << call << "\n";
+        }
+
+        if(isCached[2])
+        {
+            const auto& name = names[2];
+            const auto& source = sourceLayouts[2];
+            const auto& cache = layouts[2];
+            stream << Indent;
+            if(source.GetOrder() == cache.GetOrder())
+            {
+                PrintFormated(stream, "Copy(%_source, %_cache, %, %, %, %);    // copy output value back from cache\n", name, name, cache.GetMinorSize(), cache.GetMajorSize(), source.GetLeadingDimensionSize(), cache.GetLeadingDimensionSize());
+            }
+            else
+            {
+                PrintFormated(stream, "CopyTranspose(%_source, %_cache, %, %, %, %);    // copy output value back from cache\n", name, name, cache.GetMajorSize(), cache.GetMinorSize(), source.GetLeadingDimensionSize(), cache.GetLeadingDimensionSize());
+            }
+        }
+
+        for(int operand = 0; operand < 3; ++operand)
+        {
+            if(isCached[operand] && IsHeapCache(layouts[operand]))
+            {
+                stream << Indent;
+                PrintFormated(stream, "free(%_cache);\n", names[operand]);
+            }
+        }
+
+        DecreaseIndent();
+        stream << Indent << "}\n\n";
+
+        return functionName;
+    }
+
+    int RecursiveKernelStatement::GetSplit(int m, int n, int k, int& firstSize) const
+    {
+        // choose the largest dimension that can be halved
+        int splitM = (m > _baseM) ? m : 0;
+        int splitN = (n > _baseN) ? n : 0;
+        int splitK = (k > _baseK) ? k : 0;
+
+        if(splitM >= splitN && splitM >= splitK && splitM > 0)
+        {
+            firstSize = (m / _baseM / 2) * _baseM;
+            return 0;
+        }
+        else if(splitN >= splitK && splitN > 0)
+        {
+            firstSize = (n / _baseN / 2) * _baseN;
+            return 1;
+        }
+        else if(splitK > 0)
+        {
+            firstSize = (k / _baseK / 2) * _baseK;
+            return 2;
+        }
+        return -1;
+    }
+
+    bool RecursiveKernelStatement::IsHeapCache(const MatrixLayout& cacheLayout)
+    {
+        // caches of more than 64KB would risk overflowing the stack of a deep recursion
+        return cacheLayout.Size() > 16384;
+    }
+
+    std::string RecursiveKernelStatement::GetFunctionName(int index) const
+    {
+        auto name = GetVariable().GetName();
+        return (index < 0) ? name : name + "_" + std::to_string(index);
+    }
 }
@@ -0,0 +1,224 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     Strassen.cpp
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "PrintUtils.h"
+#include "Strassen.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace tiler
+{
+    // the coefficients of the quadrants (11, 12, 21, 22) of A and B in each sub-product, and of each sub-product in the quadrants of C
+    struct StrassenCoefficients
+    {
+        float operands[3][7][4];
+    };
+
+    const StrassenCoefficients strassenCoefficients =
+    {{
+        { {1, 0, 0, 1}, {0, 0, 1, 1}, {1, 0, 0, 0}, {0, 0, 0, 1}, {1, 1, 0, 0}, {-1, 0, 1, 0}, {0, 1, 0, -1} },
+        { {1, 0, 0, 1}, {1, 0, 0, 0}, {0, 1, 0, -1}, {-1, 0, 1, 0}, {0, 0, 0, 1}, {1, 1, 0, 0}, {0, 0, 1, 1} },
+        { {1, 0, 0, 1}, {0, 0, 1, -1}, {0, 1, 0, 1}, {1, 0, 1, 0}, {-1, 1, 0, 0}, {0, 0, 0, 1}, {1, 0, 0, 0} }
+    }};
+
+    const StrassenCoefficients winogradCoefficients =
+    {{
+        { {1, 0, 0, 0}, {0, 1, 0, 0}, {1, 1, -1, -1}, {0, 0, 0, 1}, {0, 0, 1, 1}, {-1, 0, 1, 1}, {1, 0, -1, 0} },
+        { {1, 0, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}, {1, -1, -1, 1}, {-1, 1, 0, 0}, {1, -1, 0, 1}, {0, -1, 0, 1} },
+        { {1, 1, 1, 1}, {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, -1, 0}, {0, 1, 0, 1}, {0, 1, 1, 1}, {0, 0, 1, 1} }
+    }};
+
+    // Determines if every use of a combination in a nest is a cached tile, so that its terms can be summed as the tiles are packed
+    bool IsFusedIntoPacking(const Nest& nest, const Nest::StatementPtr& combination)
+    {
+        for(const auto& statement : nest.GetStatements())
+        {
+            auto tileStatement = std::dynamic_pointer_cast<TileStatement>(statement);
+            if(tileStatement != nullptr && tileStatement->GetMatrixStatement() == combination && !tileStatement->IsCached())
+            {
+                return false;
+            }
+
+            auto kernelStatement = std::dynamic_pointer_cast<KernelStatement>(statement);
+            if(kernelStatement != nullptr && (kernelStatement->GetMatrixAStatement() == combination || kernelStatement->GetMatrixBStatement() == combination || kernelStatement->GetMatrixCStatement() == combination))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    StrassenNest::StrassenNest(MatrixLayout layoutA, MatrixLayout layoutB, MatrixLayout layoutC, float* dataA, float* dataB, float* dataC, const SubproductSchedule& schedule, StrassenOptions options) : _options(options)
+    {
+        if(layoutA.NumRows() != layoutC.NumRows() || layoutB.NumColumns() != layoutC.NumColumns() || layoutA.NumColumns() != layoutB.NumRows())
+        {
+            throw std::logic_error("sizes of the operands of the Strassen transform are incompatible");
+        }
+
+        _operands[0] = std::make_shared<UsingStatement>(Variable(), layoutA, false, dataA);
+        _operands[1] = std::make_shared<UsingStatement>(Variable(), layoutB, false, dataB);
+        _operands[2] = std::make_shared<UsingStatement>(Variable(), layoutC, true, dataC);
+
+        // each level halves M, N, and K
+        int m = layoutC.NumRows();
+        int n = layoutC.NumColumns();
+        int k = layoutA.NumColumns();
+        while(_numLevels < _options.maxLevels && std::min({m, n, k}) >= _options.crossover && m % 2 == 0 && n % 2 == 0 && k % 2 == 0)
+        {
+            m /= 2;
+            n /= 2;
+            k /= 2;
+            ++_numLevels;
+        }
+
+        // the workspace has a region for each operand
+        int subSizes[] = { m * k, k * n, m * n };
+        _workspaceOffsets[1] = subSizes[0];
+        _workspaceOffsets[2] = subSizes[0] + subSizes[1];
+
+        int numSubproducts = 1;
+        for(int level = 0; level < _numLevels; ++level)
+        {
+            numSubproducts *= 7;
+        }
+
+        for(int index = 0; index < numSubproducts; ++index)
+        {
+            bool materialize[3] = { false, false, false };
+            auto subproduct = BuildSubproduct(index, schedule, materialize);
+
+            // combinations that can't be fused into packing are materialized, which requires rebuilding the schedule
+            bool requiresWorkspace = false;
+            for(int operand = 0; operand < 3; ++operand)
+            {
+                auto combination = std::dynamic_pointer_cast<CombinationUsingStatement>(subproduct->GetStatements()[operand]);
+                if(!combination->IsView() && !IsFusedIntoPacking(*subproduct, combination))
+                {
+                    materialize[operand] = true;
+                    requiresWorkspace = true;
+                    _workspaceSize = std::max(_workspaceSize, _workspaceOffsets[operand] + subSizes[operand]);
+                }
+            }
+
+            if(requiresWorkspace)
+            {
+                subproduct = BuildSubproduct(index, schedule, materialize);
+            }
+            _subproducts.push_back(subproduct);
+        }
+
+        if(_workspaceSize > _options.workspaceBound)
+        {
+            throw std::logic_error("Strassen workspace of " + std::to_string(_workspaceSize) + " floats exceeds the bound of " + std::to_string(_options.workspaceBound));
+        }
+    }
+
+    std::shared_ptr<Nest> StrassenNest::BuildSubproduct(int index, const SubproductSchedule& schedule, const bool materialize[3])
+    {
+        const auto& coefficients = (_options.variant == StrassenVariant::strassen) ? strassenCoefficients : winogradCoefficients;
+
+        // the index of the sub-product at each level, outermost level first
+        std::vector<int> products(_numLevels);
+        for(int level = _numLevels - 1; level >= 0; --level)
+        {
+            products[level] = index % 7;
+            index /= 7;
+        }
+
+        auto nest = std::make_shared<Nest>();
+        Variable variables[3];
+        for(int operand = 0; operand < 3; ++operand)
+        {
+            // the terms of the combination are the Kronecker product of the quadrant coefficients of each level
+            auto parentLayout = _operands[operand]->GetLayout();
+            int numRows = parentLayout.NumRows();
+            int numColumns = parentLayout.NumColumns();
+            std::vector<CombinationUsingStatement::Term> terms = { {0, 1.0f} };
+            for(int level = 0; level < _numLevels; ++level)
+            {
+                numRows /= 2;
+                numColumns /= 2;
+
+                std::vector<CombinationUsingStatement::Term> levelTerms;
+                for(const auto& term : terms)
+                {
+                    for(int quadrant = 0; quadrant < 4; ++quadrant)
+                    {
+                        float coefficient = coefficients.operands[operand][products[level]][quadrant];
+                        if(coefficient != 0)
+                        {
+                            int offset = parentLayout((quadrant / 2) * numRows, (quadrant % 2) * numColumns);
+                            levelTerms.push_back({term.offset + offset, term.coefficient * coefficient});
+                        }
+                    }
+                }
+                terms = levelTerms;
+            }
+
+            MatrixLayout layout(numRows, numColumns, parentLayout.GetOrder(), parentLayout.GetLeadingDimensionSize());
+            auto combination = std::make_shared<CombinationUsingStatement>(variables[operand], layout, operand == 2, _operands[operand]->GetVariable(), terms);
+            if(materialize[operand])
+            {
+                combination->Materialize(_workspace.GetName() + " + " + std::to_string(_workspaceOffsets[operand]));
+            }
+            nest->AddStatement(combination);
+        }
+
+        schedule(NestStatementAppender(nest), variables[0], variables[1], variables[2]);
+        return nest;
+    }
+
+    void StrassenNest::Print(std::ostream& stream, Instrumentation instrumentation)
+    {
+        IncreaseIndent();
+
+        std::vector<Nest::StatementPtr> statements(std::begin(_operands), std::end(_operands));
+        for(const auto& subproduct : _subproducts)
+        {
+            statements.insert(statements.end(), subproduct->GetStatements().begin(), subproduct->GetStatements().end());
+        }
+        Nest::PrintFunctions(stream, statements);
+
+        StatementProfiler profiler(instrumentation, statements);
+        profiler.PrintFunctions(stream);
+
+        // start main function
+        stream << Indent << "int main()\n" << Indent << "{\n";
+        IncreaseIndent();
+        profiler.PrintStart(stream);
+
+        for(const auto& operand : _operands)
+        {
+            operand->PrintForward(stream);
+        }
+
+        if(_workspaceSize > 0)
+        {
+            stream << Indent;
+            PrintFormated(stream, "alignas(64) static float %[%];    // Strassen workspace\n", _workspace.GetName(), _workspaceSize);
+        }
+
+        // the sub-products run one after the other, each in its own scope
+        for(int index = 0; index < NumSubproducts(); ++index)
+        {
+            stream << Indent;
+            PrintFormated(stream, "{    // Strassen sub-product %, levels:%\n", index, _numLevels);
+            IncreaseIndent();
+            _subproducts[index]->PrintBody(stream, profiler);
+            DecreaseIndent();
+            stream << Indent << "}\n";
+        }
+        profiler.PrintReport(stream);
+
+        //print prefix
+        DecreaseIndent();
+        stream << Indent << "}";
+    }
+}
@@ -0,0 +1,304 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     X64Emitter.cpp
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "X64Emitter.h"
+
+#include <stdexcept>
+
+namespace tiler
+{
+    X64Emitter::X64Emitter(bool useVex) : _useVex(useVex)
+    {}
+
+    void X64Emitter::Push(Gpr reg)
+    {
+        EmitRex(false, 0, static_cast<int>(reg));
+        _code.push_back(0x50 + (static_cast<int>(reg) & 7));
+    }
+
+    void X64Emitter::Pop(Gpr reg)
+    {
+        EmitRex(false, 0, static_cast<int>(reg));
+        _code.push_back(0x58 + (static_cast<int>(reg) & 7));
+    }
+
+    void X64Emitter::Return()
+    {
+        _code.push_back(0xC3);
+    }
+
+    void X64Emitter::MoveImmediate(Gpr target, int64_t value)
+    {
+        EmitRex(true, 0, static_cast<int>(target));
+        _code.push_back(0xB8 + (static_cast<int>(target) & 7));
+        Emit32(static_cast<uint32_t>(value));
+        Emit32(static_cast<uint32_t>(static_cast<uint64_t>(value) >> 32));
+    }
+
+    void X64Emitter::Move(Gpr target, Gpr source)
+    {
+        EmitRex(true, static_cast<int>(source), static_cast<int>(target));
+        _code.push_back(0x89);
+        EmitRegisterOperand(static_cast<int>(source), static_cast<int>(target));
+    }
+
+    void X64Emitter::Load(Gpr target, Gpr base, int32_t displacement)
+    {
+        EmitRex(true, static_cast<int>(target), static_cast<int>(base));
+        _code.push_back(0x8B);
+        EmitMemoryOperand(static_cast<int>(target), base, displacement);
+    }
+
+    void X64Emitter::Store(Gpr base, int32_t displacement, Gpr source)
+    {
+        EmitRex(true, static_cast<int>(source), static_cast<int>(base));
+        _code.push_back(0x89);
+        EmitMemoryOperand(static_cast<int>(source), base, displacement);
+    }
+
+    void X64Emitter::AddImmediate(Gpr target, int32_t value)
+    {
+        EmitRex(true, 0, static_cast<int>(target));
+        _code.push_back(0x81);
+        EmitRegisterOperand(0, static_cast<int>(target));
+        Emit32(static_cast<uint32_t>(value));
+    }
+
+    void X64Emitter::SubtractImmediate(Gpr target, int32_t value)
+    {
+        EmitRex(true, 0, static_cast<int>(target));
+        _code.push_back(0x81);
+        EmitRegisterOperand(5, static_cast<int>(target));
+        Emit32(static_cast<uint32_t>(value));
+    }
+
+    void X64Emitter::Add(Gpr target, Gpr source)
+    {
+        EmitRex(true, static_cast<int>(source), static_cast<int>(target));
+        _code.push_back(0x01);
+        EmitRegisterOperand(static_cast<int>(source), static_cast<int>(target));
+    }
+
+    void X64Emitter::MultiplyImmediate(Gpr target, Gpr source, int32_t value)
+    {
+        EmitRex(true, static_cast<int>(target), static_cast<int>(source));
+        _code.push_back(0x69);
+        EmitRegisterOperand(static_cast<int>(target), static_cast<int>(source));
+        Emit32(static_cast<uint32_t>(value));
+    }
+
+    void X64Emitter::CompareImmediate(Gpr reg, int32_t value)
+    {
+        EmitRex(true, 0, static_cast<int>(reg));
+        _code.push_back(0x81);
+        EmitRegisterOperand(7, static_cast<int>(reg));
+        Emit32(static_cast<uint32_t>(value));
+    }
+
+    size_t X64Emitter::Jump(size_t target)
+    {
+        return EmitJump(-1, target);
+    }
+
+    size_t X64Emitter::JumpIfLess(size_t target)
+    {
+        return EmitJump(0x8C, target);
+    }
+
+    size_t X64Emitter::JumpIfNotZero(size_t target)
+    {
+        return EmitJump(0x85, target);
+    }
+
+    void X64Emitter::PatchJump(size_t displacementPosition, size_t target)
+    {
+        auto displacement = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(displacementPosition + 4));
+        for(int byte = 0; byte < 4; ++byte)
+        {
+            _code[displacementPosition + byte] = static_cast<uint8_t>(displacement >> (8 * byte));
+        }
+    }
+
+    void X64Emitter::Call(size_t target)
+    {
+        _code.push_back(0xE8);
+        auto displacementPosition = _code.size();
+        Emit32(0);
+        PatchJump(displacementPosition, target);
+    }
+
+    void X64Emitter::CallRegister(Gpr reg)
+    {
+        EmitRex(false, 0, static_cast<int>(reg));
+        _code.push_back(0xFF);
+        EmitRegisterOperand(2, static_cast<int>(reg));
+    }
+
+    void X64Emitter::LoadFloats(int target, Gpr base, int32_t displacement, int width)
+    {
+        if(_useVex)
+        {
+            // vmovss or vmovups
+            EmitVex(1, width == 1 ? 2 : 0, false, width == 8, target, 0, static_cast<int>(base));
+            _code.push_back(0x10);
+        }
+        else
+        {
+            // movss or movups
+            EmitSse(width == 1 ? 0xF3 : 0, 0x10, target, static_cast<int>(base));
+        }
+        EmitMemoryOperand(target, base, displacement);
+    }
+
+    void X64Emitter::StoreFloats(Gpr base, int32_t displacement, int source, int width)
+    {
+        if(_useVex)
+        {
+            EmitVex(1, width == 1 ? 2 : 0, false, width == 8, source, 0, static_cast<int>(base));
+            _code.push_back(0x11);
+        }
+        else
+        {
+            EmitSse(width == 1 ? 0xF3 : 0, 0x11, source, static_cast<int>(base));
+        }
+        EmitMemoryOperand(source, base, displacement);
+    }
+
+    void X64Emitter::ZeroFloats(int target)
+    {
+        // xorps, which clears the whole ymm register in its VEX form
+        if(_useVex)
+        {
+            EmitVex(1, 0, false, false, target, target, target);
+            _code.push_back(0x57);
+        }
+        else
+        {
+            EmitSse(0, 0x57, target, target);
+        }
+        EmitRegisterOperand(target, target);
+    }
+
+    void X64Emitter::BroadcastFloat(int target, Gpr base, int32_t displacement, int width)
+    {
+        if(!_useVex)
+        {
+            // movss, the scalar lane is all that SSE code uses
+            LoadFloats(target, base, displacement, 1);
+            return;
+        }
+
+        // vbroadcastss
+        EmitVex(2, 1, false, width == 8, target, 0, static_cast<int>(base));
+        _code.push_back(0x18);
+        EmitMemoryOperand(target, base, displacement);
+    }
+
+    void X64Emitter::MultiplyFloat(int target, Gpr base, int32_t displacement)
+    {
+        // mulss
+        EmitSse(0xF3, 0x59, target, static_cast<int>(base));
+        EmitMemoryOperand(target, base, displacement);
+    }
+
+    void X64Emitter::AddFloat(int target, int source)
+    {
+        // addss
+        EmitSse(0xF3, 0x58, target, source);
+        EmitRegisterOperand(target, source);
+    }
+
+    void X64Emitter::MultiplyAddFloats(int accumulator, int multiplier, Gpr base, int32_t displacement, int width)
+    {
+        if(!_useVex)
+        {
+            throw std::logic_error("fused multiply-add requires VEX encoding");
+        }
+
+        // vfmadd231ss or vfmadd231ps
+        EmitVex(2, 1, false, width == 8, accumulator, multiplier, static_cast<int>(base));
+        _code.push_back(width == 1 ? 0xB9 : 0xB8);
+        EmitMemoryOperand(accumulator, base, displacement);
+    }
+
+    void X64Emitter::ZeroUpper()
+    {
+        _code.insert(_code.end(), {0xC5, 0xF8, 0x77});
+    }
+
+    void X64Emitter::EmitRex(bool wide, int reg, int rm)
+    {
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | (((reg >> 3) & 1) << 2) | ((rm >> 3) & 1);
+        if(rex != 0x40)
+        {
+            _code.push_back(rex);
+        }
+    }
+
+    void X64Emitter::EmitMemoryOperand(int reg, Gpr base, int32_t displacement)
+    {
+        // a base of rsp or r12 would require a SIB byte
+        if(base == Gpr::rsp || base == Gpr::r12)
+        {
+            throw std::logic_error("rsp and r12 can't be memory bases");
+        }
+
+        _code.push_back(0x80 | ((reg & 7) << 3) | (static_cast<int>(base) & 7));
+        Emit32(static_cast<uint32_t>(displacement));
+    }
+
+    void X64Emitter::EmitRegisterOperand(int reg, int rm)
+    {
+        _code.push_back(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void X64Emitter::EmitVex(int map, int prefix, bool wide, bool longVector, int reg, int vvvv, int rm)
+    {
+        // the three-byte form, where the register extension bits and vvvv are inverted
+        _code.push_back(0xC4);
+        _code.push_back(((~reg >> 3) & 1) << 7 | 1 << 6 | ((~rm >> 3) & 1) << 5 | map);
+        _code.push_back((wide ? 1 : 0) << 7 | (~vvvv & 15) << 3 | (longVector ? 1 : 0) << 2 | prefix);
+    }
+
+    void X64Emitter::EmitSse(int prefix, int opcode, int reg, int rm)
+    {
+        if(prefix != 0)
+        {
+            _code.push_back(static_cast<uint8_t>(prefix));
+        }
+        EmitRex(false, reg, rm);
+        _code.push_back(0x0F);
+        _code.push_back(static_cast<uint8_t>(opcode));
+    }
+
+    size_t X64Emitter::EmitJump(int opcode, size_t target)
+    {
+        if(opcode < 0)
+        {
+            _code.push_back(0xE9);
+        }
+        else
+        {
+            _code.push_back(0x0F);
+            _code.push_back(static_cast<uint8_t>(opcode));
+        }
+
+        auto displacementPosition = _code.size();
+        Emit32(0);
+        PatchJump(displacementPosition, target);
+        return displacementPosition;
+    }
+
+    void X64Emitter::Emit32(uint32_t value)
+    {
+        for(int byte = 0; byte < 4; ++byte)
+        {
+            _code.push_back(static_cast<uint8_t>(value >> (8 * byte)));
+        }
+    }
+}
@@ -0,0 +1,769 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  Project:  tiler
+//  File:     NestTest.cpp
+//  Authors:  Ofer Dekel
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The correctness suite. Each case builds a nest, prints it as a C++ program, and compiles and runs the program with the C++
+// compiler of the build. The output of the program is checked against a reference product in double precision. Cases that
+// the machine-code backend supports are also run by it, for every instruction set that the CPU supports. Usage:
+//
+//     tiler_test [--compiler c++] [--directory path]
+//
+// The printed programs, and their outputs, are kept in the directory for inspection
+
+#include "CompiledNest.h"
+#include "Kernel.h"
+#include "MatrixVector.h"
+#include "Nest.h"
+#include "Schedule.h"
+#include "ScheduleDatabase.h"
+#include "StaticNest.h"
+#include "Strassen.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace tiler;
+
+#ifndef TILER_TEST_COMPILER
+#define TILER_TEST_COMPILER "c++"
+#endif
+
+// The operands of a product C += A * B, with small integers that make every product exact
+struct TestData
+{
+    TestData(const MatrixLayout& layoutA, const MatrixLayout& layoutB, const MatrixLayout& layoutC) :
+        layoutA(layoutA), layoutB(layoutB), layoutC(layoutC), a(layoutA.Size()), b(layoutB.Size()), c(layoutC.Size()), expected(layoutC.Size())
+    {
+        for(size_t index = 0; index < a.size(); ++index)
+        {
+            a[index] = static_cast<float>(index % 7) - 3;
+        }
+
+        for(size_t index = 0; index < b.size(); ++index)
+        {
+            b[index] = static_cast<float>(index % 5) - 2;
+        }
+
+        for(size_t index = 0; index < c.size(); ++index)
+        {
+            c[index] = static_cast<float>(index % 3);
+        }
+        ComputeExpected();
+    }
+
+    // Computes the expected output from the operands, again after a builder changes them
+    void ComputeExpected()
+    {
+        for(int i = 0; i < layoutC.NumRows(); ++i)
+        {
+            for(int j = 0; j < layoutC.NumColumns(); ++j)
+            {
+                double sum = c[layoutC(i, j)];
+                for(int l = 0; l < layoutA.NumColumns(); ++l)
+                {
+                    sum += static_cast<double>(a[layoutA(i, l)]) * b[layoutB(l, j)];
+                }
+                expected[layoutC(i, j)] = static_cast<float>(sum);
+            }
+        }
+    }
+
+    MatrixLayout layoutA, layoutB, layoutC;
+    std::vector<float> a, b, c;
+    std::vector<float> expected;
+
+    // where builders write files, such as the files of mapped matrices
+    std::string directory = ".";
+
+    // an extra operand for builders of longer chains, which compute the expected output themselves
+    std::vector<float> d;
+};
+
+// Builds a nest that computes C += A * B from the data, with the given variables for the Using statements of the operands
+using NestBuilder = std::function<std::shared_ptr<Nest>(TestData& data, const Variable& A, const Variable& B, const Variable& C)>;
+
+// Prints a program that computes C += A * B from the data without a nest, and returns the name of C in the program
+using ProgramPrinter = std::function<std::string(TestData& data, std::ostream& stream)>;
+
+struct TestCase
+{
+    std::string name;
+    MatrixLayout layoutA, layoutB, layoutC;
+    NestBuilder builder;
+    bool isCompiled;
+
+    // the printed program of an instrumented case writes its profile to <name>.json, which must list its statements
+    Instrumentation instrumentation = Instrumentation::none;
+
+    // prints the program of a case that has no builder
+    ProgramPrinter printer = nullptr;
+
+    // environment variables of the printed program, such as TILER_NUMA_NODES=2 to simulate two NUMA nodes
+    std::string environment;
+};
+
+// Returns a builder of the matrix-vector schedule, with plain Using statements
+NestBuilder MatrixVectorBuilder(int panelSize, bool parallel)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        auto nest = MakeNest();
+        nest.Using(A, data.layoutA, false, data.a.data());
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        AppendMatrixVectorSchedule(nest, A, B, C, panelSize, parallel);
+        return nest.GetNest();
+    };
+}
+
+// Returns a builder that writes the schedule of a tiled product, with a constant B and no data, and reads it back with the data
+NestBuilder DeserializedBuilder(int tileM, int tileN, int tileK)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        Variable i, j, l, AA, BB, CC;
+        auto nest = MakeNest();
+        nest.Using(A, data.layoutA, false, nullptr);
+        nest.Using(B, data.layoutB, false, nullptr).Constant();
+        nest.Using(C, data.layoutC, true, nullptr);
+        nest.ForAll(i, 0, data.layoutC.NumRows(), tileM)
+            .ForAll(l, 0, data.layoutA.NumColumns(), tileK)
+            .ForAll(j, 0, data.layoutC.NumColumns(), tileN)
+            .Tile(AA, A, i, l, tileM, tileK)
+            .Tile(BB, B, l, j, tileK, tileN).Cache(MatrixOrder::rowMajor)
+            .Tile(CC, C, i, j, tileM, tileN)
+            .Kernel(AA, BB, CC, MVKernel);
+
+        std::stringstream schedule;
+        SerializeNest(*nest.GetNest(), schedule);
+        return DeserializeNest(schedule, {data.layoutA, data.layoutB, data.layoutC}, {data.a.data(), data.b.data(), data.c.data()});
+    };
+}
+
+// Returns a builder that tunes a tiled schedule for a cube of the given size, saves and loads the database, and dispatches
+// the problem of the data from it. The database also holds a schedule that does nothing, for C in the other order, which
+// must never be picked
+NestBuilder DispatchedBuilder(int tunedSize, int tileM, int tileN, int tileK)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        auto orderC = data.layoutC.GetOrder();
+        auto otherOrderC = (orderC == MatrixOrder::rowMajor) ? MatrixOrder::columnMajor : MatrixOrder::rowMajor;
+        MatrixLayout tunedA(tunedSize, tunedSize, data.layoutA.GetOrder());
+        MatrixLayout tunedB(tunedSize, tunedSize, data.layoutB.GetOrder());
+        MatrixLayout tunedC(tunedSize, tunedSize, orderC);
+
+        Variable i, j, l, AA, BB, CC;
+        auto tuned = MakeNest();
+        tuned.Using(A, tunedA, false, nullptr);
+        tuned.Using(B, tunedB, false, nullptr);
+        tuned.Using(C, tunedC, true, nullptr);
+        tuned.ForAll(i, 0, tunedSize, tileM)
+            .ForAll(l, 0, tunedSize, tileK)
+            .ForAll(j, 0, tunedSize, tileN)
+            .Tile(AA, A, i, l, tileM, tileK).Cache(MatrixOrder::columnMajor)
+            .Tile(BB, B, l, j, tileK, tileN).Cache(MatrixOrder::rowMajor)
+            .Tile(CC, C, i, j, tileM, tileN)
+            .Kernel(AA, BB, CC, MVKernel);
+
+        auto empty = MakeNest();
+        empty.Using(A, tunedA, false, nullptr);
+        empty.Using(B, tunedB, false, nullptr);
+        empty.Using(C, MatrixLayout(tunedSize, tunedSize, otherOrderC), true, nullptr);
+
+        ScheduleDatabase database;
+        database.Add({tunedSize, tunedSize, tunedSize, tunedA.GetOrder(), tunedB.GetOrder(), orderC, "float", GetCpuModel()}, *tuned.GetNest());
+        database.Add({data.layoutC.NumRows(), data.layoutC.NumColumns(), data.layoutA.NumColumns(), tunedA.GetOrder(), tunedB.GetOrder(), otherOrderC, "float", GetCpuModel()}, *empty.GetNest());
+
+        std::stringstream saved;
+        database.Save(saved);
+        ScheduleDatabase loaded;
+        loaded.Load(saved);
+        std::ostringstream resaved;
+        loaded.Save(resaved);
+        if(loaded.Size() != 2 || resaved.str() != saved.str())
+        {
+            throw std::runtime_error("the schedule database changed when it was saved and loaded");
+        }
+
+        return DispatchSchedule(loaded, data.layoutA, data.layoutB, data.layoutC, data.a.data(), data.b.data(), data.c.data());
+    };
+}
+
+// Returns a printer of two levels of the Strassen transform, with sub-products whose tiles are all cached, so that their
+// combinations are summed as they are packed, or uncached, so that their combinations are materialized in the workspace
+ProgramPrinter StrassenPrinter(StrassenVariant variant, bool isFused)
+{
+    return [=](TestData& data, std::ostream& stream)
+    {
+        // the sub-products are a sixteenth of the product, and each is tiled into 8x8 tiles of A and 8x4 tiles of B
+        int m = data.layoutC.NumRows() / 4;
+        int n = data.layoutC.NumColumns() / 4;
+        int k = data.layoutA.NumColumns() / 4;
+        auto schedule = [=](NestStatementAppender nest, const Variable& A, const Variable& B, const Variable& C)
+        {
+            Variable i, j, l, AA, BB, CC;
+            nest.ForAll(i, 0, m, 8)
+                .ForAll(l, 0, k, 8)
+                .ForAll(j, 0, n, 4);
+            auto tileA = nest.Tile(AA, A, i, l, 8, 8);
+            auto tileB = nest.Tile(BB, B, l, j, 8, 4);
+            auto tileC = nest.Tile(CC, C, i, j, 8, 4);
+            if(isFused)
+            {
+                tileA.Cache(MatrixOrder::columnMajor);
+                tileB.Cache(MatrixOrder::rowMajor);
+                tileC.Cache(MatrixOrder::rowMajor);
+            }
+            nest.Kernel(AA, BB, CC, MVKernel);
+        };
+
+        StrassenOptions options;
+        options.crossover = 8;
+        options.maxLevels = 2;
+        options.variant = variant;
+        StrassenNest strassen(data.layoutA, data.layoutB, data.layoutC, data.a.data(), data.b.data(), data.c.data(), schedule, options);
+        if(strassen.NumLevels() != 2 || (strassen.GetWorkspaceSize() == 0) != isFused)
+        {
+            throw std::logic_error("the Strassen transform has " + std::to_string(strassen.NumLevels()) + " levels and a workspace of " + std::to_string(strassen.GetWorkspaceSize()) + " floats");
+        }
+
+        strassen.Print(stream);
+        return strassen.GetOperand(2).GetVariable().GetName();
+    };
+}
+
+// Returns a builder of a tiled product, loops over rows, then K, then columns, with tiles that are cached in the given orders
+NestBuilder TiledBuilder(int tileM, int tileN, int tileK, MatrixOrder cacheOrderA, MatrixOrder cacheOrderB)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        Variable i, j, l, AA, BB, CC;
+        auto nest = MakeNest();
+        nest.Using(A, data.layoutA, false, data.a.data());
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        nest.ForAll(i, 0, data.layoutC.NumRows(), tileM)
+            .ForAll(l, 0, data.layoutA.NumColumns(), tileK)
+            .ForAll(j, 0, data.layoutC.NumColumns(), tileN)
+            .Tile(AA, A, i, l, tileM, tileK).Cache(cacheOrderA)
+            .Tile(BB, B, l, j, tileK, tileN).Cache(cacheOrderB)
+            .Tile(CC, C, i, j, tileM, tileN)
+            .Kernel(AA, BB, CC, MVKernel);
+        return nest.GetNest();
+    };
+}
+
+// Returns a builder that maps A from a file, which it writes; the file name has a quote and a backslash, which the printed
+// string literal must escape
+NestBuilder MappedBuilder(int tileM, int tileN, int tileK)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        auto path = data.directory + "/mapped_\"" + A.GetName() + "\\.bin";
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.a.data()), data.layoutA.GetDataSize() * sizeof(float));
+        file.close();
+
+        Variable i, j, l, AA, BB, CC;
+        auto nest = MakeNest();
+        nest.UsingMapped(A, data.layoutA, false, path);
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        nest.ForAll(i, 0, data.layoutC.NumRows(), tileM)
+            .ForAll(l, 0, data.layoutA.NumColumns(), tileK)
+            .ForAll(j, 0, data.layoutC.NumColumns(), tileN)
+            .Tile(AA, A, i, l, tileM, tileK)
+            .Tile(BB, B, l, j, tileK, tileN)
+            .Tile(CC, C, i, j, tileM, tileN)
+            .Kernel(AA, BB, CC, MVKernel);
+        return nest.GetNest();
+    };
+}
+
+// Returns a builder of a recursive kernel that caches A at the top, B one level down, and C two levels down
+NestBuilder RecursiveBuilder(int baseSize)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        auto nest = MakeNest();
+        nest.Using(A, data.layoutA, false, data.a.data());
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        nest.RecursiveKernel(A, B, C, MVKernel, baseSize, baseSize, baseSize)
+            .CacheAt(A, 0, MatrixOrder::columnMajor)
+            .CacheAt(B, 1, MatrixOrder::rowMajor)
+            .CacheAt(C, 2, MatrixOrder::columnMajor);
+        return nest.GetNest();
+    };
+}
+
+// Returns a builder that copies A into a padded array
+NestBuilder PaddedBuilder(int tileM, int tileK)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        Variable i, j, l, AA, BB, CC;
+        auto nest = MakeNest();
+        nest.UsingPadded(A, data.layoutA, data.a.data());
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        nest.ForAll(i, 0, data.layoutC.NumRows(), tileM)
+            .ForAll(l, 0, data.layoutA.NumColumns(), tileK)
+            .ForAll(j, 0, data.layoutC.NumColumns(), data.layoutC.NumColumns())
+            .Tile(AA, A, i, l, tileM, tileK)
+            .Tile(BB, B, l, j, tileK, data.layoutC.NumColumns())
+            .Tile(CC, C, i, j, tileM, data.layoutC.NumColumns())
+            .Kernel(AA, BB, CC, MVKernel);
+        return nest.GetNest();
+    };
+}
+
+// Returns a builder whose outermost loop is parallel: the loop over rows, whose threads cache their own tiles (from a copy
+// of B on their own NUMA node, if B is replicated), or the loop over K, whose threads accumulate into partial copies of C
+NestBuilder ParallelBuilder(int tileM, int tileN, int tileK, bool isSplit, bool isReplicated)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        Variable i, j, l, AA, BB, CC;
+        auto nest = MakeNest();
+        nest.Using(A, data.layoutA, false, data.a.data());
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        if(isSplit)
+        {
+            nest.ForAll(l, 0, data.layoutA.NumColumns(), tileK).Parallel()
+                .ForAll(i, 0, data.layoutC.NumRows(), tileM);
+        }
+        else
+        {
+            auto loop = nest.ForAll(i, 0, data.layoutC.NumRows(), tileM).Parallel();
+            if(isReplicated)
+            {
+                loop.Replicate(B);
+            }
+            loop.ForAll(l, 0, data.layoutA.NumColumns(), tileK);
+        }
+
+        nest.ForAll(j, 0, data.layoutC.NumColumns(), tileN)
+            .Tile(AA, A, i, l, tileM, tileK).Cache(MatrixOrder::columnMajor)
+            .Tile(BB, B, l, j, tileK, tileN).Cache(MatrixOrder::rowMajor)
+            .Tile(CC, C, i, j, tileM, tileN)
+            .Kernel(AA, BB, CC, MVKernel);
+        return nest.GetNest();
+    };
+}
+
+// Returns a builder whose parallel loop over rows caches the tiles of B in one buffer for the team, which the threads pack
+// together between barriers
+NestBuilder SharedCacheBuilder(int tileM, int tileN, int tileK)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        Variable i, j, l, AA, BB, CC;
+        auto nest = MakeNest();
+        nest.Using(A, data.layoutA, false, data.a.data());
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        nest.ForAll(i, 0, data.layoutC.NumRows(), tileM).Parallel()
+            .ForAll(l, 0, data.layoutA.NumColumns(), tileK)
+            .ForAll(j, 0, data.layoutC.NumColumns(), tileN)
+            .Tile(AA, A, i, l, tileM, tileK).Cache(MatrixOrder::columnMajor)
+            .Tile(BB, B, l, j, tileK, tileN).CacheShared(MatrixOrder::rowMajor)
+            .Tile(CC, C, i, j, tileM, tileN)
+            .Kernel(AA, BB, CC, MVKernel);
+        return nest.GetNest();
+    };
+}
+
+// Returns a builder of a block-sparse A, after zeroing every block whose row and column add up to an odd number
+NestBuilder BlockSparseBuilder(int blockSize, int tileN)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        for(int i = 0; i < data.layoutA.NumRows(); ++i)
+        {
+            for(int l = 0; l < data.layoutA.NumColumns(); ++l)
+            {
+                if((i / blockSize + l / blockSize) % 2 == 1)
+                {
+                    data.a[data.layoutA(i, l)] = 0;
+                }
+            }
+        }
+        data.ComputeExpected();
+
+        Variable i, j, l, AA, BB, CC;
+        auto nest = MakeNest();
+        nest.UsingBlockSparse(A, data.layoutA, blockSize, blockSize, data.a.data());
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        nest.ForAll(i, 0, data.layoutC.NumRows(), blockSize)
+            .ForAllBlocks(l, A, i)
+            .ForAll(j, 0, data.layoutC.NumColumns(), tileN)
+            .Tile(AA, A, i, l, blockSize, blockSize)
+            .Tile(BB, B, l, j, blockSize, tileN)
+            .Tile(CC, C, i, j, blockSize, tileN)
+            .Kernel(AA, BB, CC, MVKernel);
+        return nest.GetNest();
+    };
+}
+
+// Returns a builder of the fused chain C += (A * B) * D, where D is square, and each tile of A * B is kept in a scratch tile
+// that the loop over K fills and the loop that follows it consumes
+NestBuilder ChainBuilder(int tileM, int tileN, int tileK)
+{
+    return [=](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        int m = data.layoutC.NumRows();
+        int n = data.layoutC.NumColumns();
+        MatrixLayout layoutD(n, n, MatrixOrder::rowMajor);
+        data.d.resize(layoutD.Size());
+        for(size_t index = 0; index < data.d.size(); ++index)
+        {
+            data.d[index] = static_cast<float>(index % 3) - 1;
+        }
+
+        for(int i = 0; i < m; ++i)
+        {
+            std::vector<double> product(n);
+            for(int j = 0; j < n; ++j)
+            {
+                for(int l = 0; l < data.layoutA.NumColumns(); ++l)
+                {
+                    product[j] += static_cast<double>(data.a[data.layoutA(i, l)]) * data.b[data.layoutB(l, j)];
+                }
+            }
+
+            for(int q = 0; q < n; ++q)
+            {
+                double sum = data.c[data.layoutC(i, q)];
+                for(int j = 0; j < n; ++j)
+                {
+                    sum += product[j] * data.d[layoutD(j, q)];
+                }
+                data.expected[data.layoutC(i, q)] = static_cast<float>(sum);
+            }
+        }
+
+        Variable D, T, i, j, l, q, AA, BB, DD, CC;
+        auto nest = MakeNest();
+        nest.Using(A, data.layoutA, false, data.a.data());
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(D, layoutD, false, data.d.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        nest.ForAll(i, 0, m, tileM)
+            .ForAll(j, 0, n, tileN)
+            .Scratch(T, i, j, tileM, tileN, MatrixOrder::rowMajor)
+            .ForAll(l, 0, data.layoutA.NumColumns(), tileK)
+            .Tile(AA, A, i, l, tileM, tileK)
+            .Tile(BB, B, l, j, tileK, tileN)
+            .Kernel(AA, BB, T, MVKernel);
+        nest.ForAll(q, 0, n, tileN).Follows(l)
+            .Tile(DD, D, j, q, tileN, tileN)
+            .Tile(CC, C, i, q, tileM, tileN)
+            .Kernel(T, DD, CC, MVKernel);
+        return nest.GetNest();
+    };
+}
+
+const std::vector<TestCase> testCases =
+{
+    {"gemv_prime_rows", {211, 37, MatrixOrder::rowMajor}, {37, 1, MatrixOrder::rowMajor}, {211, 1, MatrixOrder::rowMajor}, MatrixVectorBuilder(64, false), true},
+    {"gemv_column_major", {211, 37, MatrixOrder::columnMajor}, {37, 1, MatrixOrder::rowMajor}, {211, 1, MatrixOrder::rowMajor}, MatrixVectorBuilder(64, false), true},
+    {"gemv_parallel", {211, 37, MatrixOrder::rowMajor}, {37, 1, MatrixOrder::rowMajor}, {211, 1, MatrixOrder::rowMajor}, MatrixVectorBuilder(16, true), true},
+    {"tall_skinny_parallel", {150, 24, MatrixOrder::columnMajor}, {24, 5, MatrixOrder::rowMajor}, {150, 5, MatrixOrder::rowMajor}, MatrixVectorBuilder(32, true), true},
+    {"constant_deserialized", {48, 40, MatrixOrder::rowMajor}, {40, 24, MatrixOrder::rowMajor}, {48, 24, MatrixOrder::rowMajor}, DeserializedBuilder(8, 8, 8), true},
+    {"dispatched_96", {96, 96, MatrixOrder::rowMajor}, {96, 96, MatrixOrder::rowMajor}, {96, 96, MatrixOrder::rowMajor}, DispatchedBuilder(64, 32, 8, 32), true},
+    {"dispatched_128", {128, 128, MatrixOrder::rowMajor}, {128, 128, MatrixOrder::rowMajor}, {128, 128, MatrixOrder::rowMajor}, DispatchedBuilder(64, 32, 8, 32), true},
+    {"tiled_transposed", {36, 40, MatrixOrder::rowMajor}, {40, 24, MatrixOrder::columnMajor}, {36, 24, MatrixOrder::columnMajor}, TiledBuilder(12, 8, 10, MatrixOrder::columnMajor, MatrixOrder::rowMajor), true},
+    {"mapped", {32, 24, MatrixOrder::rowMajor}, {24, 16, MatrixOrder::rowMajor}, {32, 16, MatrixOrder::rowMajor}, MappedBuilder(8, 8, 8), false},
+    {"blocked_morton", {32, 32, MatrixOrder::blocked, 32, 8}, {32, 16, MatrixOrder::morton, 16, 8}, {32, 16, MatrixOrder::rowMajor}, TiledBuilder(8, 8, 8, MatrixOrder::rowMajor, MatrixOrder::rowMajor), false},
+    {"morton_groups", {32, 32, MatrixOrder::morton, 32, 8}, {32, 16, MatrixOrder::rowMajor}, {32, 16, MatrixOrder::rowMajor}, TiledBuilder(16, 8, 16, MatrixOrder::rowMajor, MatrixOrder::rowMajor), false},
+    {"recursive", {40, 36, MatrixOrder::rowMajor}, {36, 24, MatrixOrder::rowMajor}, {40, 24, MatrixOrder::rowMajor}, RecursiveBuilder(4), true},
+    {"padded", {16, 1024, MatrixOrder::rowMajor}, {1024, 4, MatrixOrder::rowMajor}, {16, 4, MatrixOrder::rowMajor}, PaddedBuilder(8, 256), true},
+    {"parallel_rows", {48, 40, MatrixOrder::rowMajor}, {40, 24, MatrixOrder::rowMajor}, {48, 24, MatrixOrder::rowMajor}, ParallelBuilder(8, 8, 8, false, false), true},
+    {"parallel_replicated", {48, 40, MatrixOrder::rowMajor}, {40, 24, MatrixOrder::rowMajor}, {48, 24, MatrixOrder::rowMajor}, ParallelBuilder(8, 8, 8, false, true), true, Instrumentation::none, nullptr, "TILER_NUMA_NODES=2"},
+    {"parallel_shared", {48, 40, MatrixOrder::rowMajor}, {40, 24, MatrixOrder::rowMajor}, {48, 24, MatrixOrder::rowMajor}, SharedCacheBuilder(8, 8, 8), false, Instrumentation::none, nullptr, "TILER_NUMA_NODES=3"},
+    {"parallel_split_k", {24, 64, MatrixOrder::rowMajor}, {64, 16, MatrixOrder::rowMajor}, {24, 16, MatrixOrder::rowMajor}, ParallelBuilder(8, 8, 8, true, false), false},
+    {"block_sparse", {32, 32, MatrixOrder::rowMajor}, {32, 8, MatrixOrder::rowMajor}, {32, 8, MatrixOrder::rowMajor}, BlockSparseBuilder(8, 8), false},
+    {"instrumented_timers", {36, 40, MatrixOrder::rowMajor}, {40, 24, MatrixOrder::columnMajor}, {36, 24, MatrixOrder::rowMajor}, TiledBuilder(12, 8, 10, MatrixOrder::columnMajor, MatrixOrder::rowMajor), false, Instrumentation::timers},
+    {"instrumented_counters", {36, 40, MatrixOrder::rowMajor}, {40, 24, MatrixOrder::columnMajor}, {36, 24, MatrixOrder::rowMajor}, TiledBuilder(12, 8, 10, MatrixOrder::columnMajor, MatrixOrder::rowMajor), false, Instrumentation::counters},
+    {"strassen_fused", {64, 32, MatrixOrder::rowMajor}, {32, 48, MatrixOrder::rowMajor}, {64, 48, MatrixOrder::rowMajor}, nullptr, false, Instrumentation::none, StrassenPrinter(StrassenVariant::strassen, true)},
+    {"strassen_materialized", {64, 32, MatrixOrder::rowMajor}, {32, 48, MatrixOrder::rowMajor}, {64, 48, MatrixOrder::rowMajor}, nullptr, false, Instrumentation::none, StrassenPrinter(StrassenVariant::strassen, false)},
+    {"winograd_fused", {64, 32, MatrixOrder::rowMajor}, {32, 48, MatrixOrder::columnMajor}, {64, 48, MatrixOrder::rowMajor}, nullptr, false, Instrumentation::none, StrassenPrinter(StrassenVariant::winograd, true)},
+    {"winograd_materialized", {64, 32, MatrixOrder::rowMajor}, {32, 48, MatrixOrder::columnMajor}, {64, 48, MatrixOrder::rowMajor}, nullptr, false, Instrumentation::none, StrassenPrinter(StrassenVariant::winograd, false)},
+    {"scratch_chain", {24, 40, MatrixOrder::rowMajor}, {40, 16, MatrixOrder::rowMajor}, {24, 16, MatrixOrder::rowMajor}, ChainBuilder(8, 8, 8), true}
+};
+
+// Returns a builder of a single row of 16x16 tiles of A, which starts at row 8, in the middle of a group of morton blocks
+NestBuilder UnalignedMortonBuilder()
+{
+    return [](TestData& data, const Variable& A, const Variable& B, const Variable& C)
+    {
+        Variable i, j, l, AA, BB, CC;
+        auto nest = MakeNest();
+        nest.Using(A, data.layoutA, false, data.a.data());
+        nest.Using(B, data.layoutB, false, data.b.data());
+        nest.Using(C, data.layoutC, true, data.c.data());
+        nest.ForAll(i, 8, 24, 16)
+            .ForAll(l, 0, 32, 16)
+            .ForAll(j, 0, 16, 8)
+            .Tile(AA, A, i, l, 16, 16).Cache(MatrixOrder::rowMajor)
+            .Tile(BB, B, l, j, 16, 8)
+            .Tile(CC, C, i, j, 16, 8)
+            .Kernel(AA, BB, CC, MVKernel);
+        return nest.GetNest();
+    };
+}
+
+// Cases whose nests must be rejected when they are built
+const std::vector<TestCase> rejectedCases =
+{
+    {"unaligned_morton", {32, 32, MatrixOrder::morton, 32, 8}, {32, 16, MatrixOrder::rowMajor}, {32, 16, MatrixOrder::rowMajor}, UnalignedMortonBuilder(), false},
+    {"dispatched_100", {100, 100, MatrixOrder::rowMajor}, {100, 100, MatrixOrder::rowMajor}, {100, 100, MatrixOrder::rowMajor}, DispatchedBuilder(64, 32, 8, 32), false}
+};
+
+// Compares an output with the expected values, at the elements of the matrix
+void Compare(const std::string& label, const TestData& data, const std::vector<float>& output)
+{
+    if(output.size() < static_cast<size_t>(data.layoutC.GetDataSize()))
+    {
+        throw std::logic_error(label + ": the output has " + std::to_string(output.size()) + " elements instead of " + std::to_string(data.layoutC.GetDataSize()));
+    }
+
+    for(int i = 0; i < data.layoutC.NumRows(); ++i)
+    {
+        for(int j = 0; j < data.layoutC.NumColumns(); ++j)
+        {
+            double value = output[data.layoutC(i, j)];
+            double expected = data.expected[data.layoutC(i, j)];
+            if(std::fabs(value - expected) > 1e-3 * (1 + std::fabs(expected)))
+            {
+                std::ostringstream message;
+                message << label << ": element (" << i << ", " << j << ") is " << value << " instead of " << expected;
+                throw std::logic_error(message.str());
+            }
+        }
+    }
+}
+
+// Returns the name of the Using statement of the output, which has its data (a deserialized nest has new variables)
+std::string GetOutputName(const Nest& nest, const float* data)
+{
+    for(const auto& statement : nest.GetStatements())
+    {
+        auto usingStatement = std::dynamic_pointer_cast<UsingStatement>(statement);
+        if(usingStatement != nullptr && usingStatement->GetData() == data)
+        {
+            return usingStatement->GetVariable().GetName();
+        }
+    }
+    throw std::logic_error("the nest has no Using statement with the data of the output");
+}
+
+// Prints the nest as a program that ends by printing C, compiles and runs it, and checks what it printed
+void CheckPrinted(const TestCase& testCase, const std::string& compiler, const std::string& directory)
+{
+    TestData data(testCase.layoutA, testCase.layoutB, testCase.layoutC);
+    data.directory = directory;
+    std::ostringstream program;
+    std::string outputName;
+    if(testCase.printer != nullptr)
+    {
+        outputName = testCase.printer(data, program);
+    }
+    else
+    {
+        Variable A, B, C;
+        auto nest = testCase.builder(data, A, B, C);
+        nest->Print(program, testCase.instrumentation);
+        outputName = GetOutputName(*nest, data.c.data());
+    }
+
+    auto text = program.str();
+    auto end = text.rfind('}');
+    std::ostringstream dump;
+    dump << "    for(int index = 0; index < " << data.layoutC.GetDataSize() << "; ++index) { printf(\"%.9g\\n\", " << outputName << "[index]); }\n";
+    text = "#include <cstdio>\n" + text.substr(0, end) + dump.str() + text.substr(end) + "\n";
+
+    auto path = directory + "/" + testCase.name;
+    std::ofstream(path + ".cpp") << text;
+    auto environment = testCase.environment + " ";
+    if(testCase.instrumentation != Instrumentation::none)
+    {
+        environment += "TILER_PROFILE_JSON=" + path + ".json ";
+    }
+    auto command = compiler + " -std=c++14 -O1 -pthread " + path + ".cpp -o " + path + ".out && " + environment + path + ".out > " + path + ".txt";
+    if(std::system(command.c_str()) != 0)
+    {
+        throw std::logic_error(testCase.name + ": failed to compile or run the printed program");
+    }
+
+    if(testCase.instrumentation != Instrumentation::none)
+    {
+        std::ostringstream report;
+        report << std::ifstream(path + ".json").rdbuf();
+        if(report.str().find("\"ForAll") == std::string::npos)
+        {
+            throw std::logic_error(testCase.name + ": the profile has no loops");
+        }
+    }
+
+    std::vector<float> output;
+    std::ifstream results(path + ".txt");
+    for(float value; results >> value; )
+    {
+        output.push_back(value);
+    }
+    Compare(testCase.name + "/printed", data, output);
+}
+
+void CheckCompiled(const TestCase& testCase, InstructionSet instructionSet)
+{
+    TestData data(testCase.layoutA, testCase.layoutB, testCase.layoutC);
+    Variable A, B, C;
+    auto nest = testCase.builder(data, A, B, C);
+    CompiledNest compiled(*nest, instructionSet);
+    compiled.Run();
+    Compare(testCase.name + (instructionSet == InstructionSet::avx2 ? "/avx2" : "/sse"), data, data.c);
+}
+
+// Runs the nest of the documentation of StaticNest.h, which the compiler of the test specializes
+void CheckStaticNest()
+{
+    enum { i, j, k };
+    using A = StaticUsing<0, 64, 64, MatrixOrder::rowMajor>;
+    using B = StaticUsing<1, 64, 64, MatrixOrder::rowMajor>;
+    using C = StaticUsing<2, 64, 64, MatrixOrder::rowMajor, true>;
+    using AA = StaticCache<3, StaticTile<A, i, k, 8, 8>, MatrixOrder::columnMajor>;
+    using BB = StaticTile<B, k, j, 8, 8>;
+    using CC = StaticTile<C, i, j, 8, 8>;
+
+    using Gemm = StaticNest<4, 3,
+        StaticForAll<i, 0, 64, 8,
+            StaticForAll<k, 0, 64, 8,
+                StaticCopy<AA,
+                    StaticForAll<j, 0, 64, 8,
+                        StaticKernel<AA, BB, CC>>>>>>;
+
+    TestData data(A::GetLayout(), B::GetLayout(), C::GetLayout());
+    Gemm::Run(data.a.data(), data.b.data(), data.c.data());
+    Compare("static_nest", data, data.c);
+}
+
+// Runs a static nest with a column-major B whose leading dimension is padded, and with cached tiles of C, which are copied
+// back after the loop over K
+void CheckStaticCachedOutput()
+{
+    enum { i, j, k };
+    using A = StaticUsing<0, 24, 40, MatrixOrder::rowMajor>;
+    using B = StaticUsing<1, 40, 16, MatrixOrder::columnMajor, false, 48>;
+    using C = StaticUsing<2, 24, 16, MatrixOrder::rowMajor, true>;
+    using AA = StaticTile<A, i, k, 8, 8>;
+    using BB = StaticTile<B, k, j, 8, 8>;
+    using CC = StaticCache<3, StaticTile<C, i, j, 8, 8>, MatrixOrder::columnMajor>;
+
+    using Gemm = StaticNest<4, 3,
+        StaticForAll<i, 0, 24, 8,
+            StaticForAll<j, 0, 16, 8,
+                StaticCopy<CC,
+                    StaticForAll<k, 0, 40, 8,
+                        StaticKernel<AA, BB, CC>>>>>>;
+
+    TestData data(A::GetLayout(), B::GetLayout(), C::GetLayout());
+    Gemm::Run(data.a.data(), data.b.data(), data.c.data());
+    Compare("static_cached_output", data, data.c);
+}
+
+void CheckRejected(const TestCase& testCase)
+{
+    TestData data(testCase.layoutA, testCase.layoutB, testCase.layoutC);
+    Variable A, B, C;
+    try
+    {
+        testCase.builder(data, A, B, C);
+    }
+    catch(const std::logic_error&)
+    {
+        return;
+    }
+    throw std::logic_error(testCase.name + ": the nest was not rejected");
+}
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        std::string compiler = TILER_TEST_COMPILER;
+        std::string directory = ".";
+        for(int index = 1; index < argc; ++index)
+        {
+            std::string argument = argv[index];
+            if(index + 1 >= argc)
+            {
+                throw std::logic_error("missing value of " + argument);
+            }
+
+            if(argument == "--compiler")
+            {
+                compiler = argv[++index];
+            }
+            else if(argument == "--directory")
+            {
+                directory = argv[++index];
+            }
+            else
+            {
+                throw std::logic_error("unknown argument " + argument);
+            }
+        }
+
+        std::vector<InstructionSet> instructionSets = { InstructionSet::sse };
+        if(GetSupportedInstructionSet() == InstructionSet::avx2)
+        {
+            instructionSets.push_back(InstructionSet::avx2);
+        }
+
+        for(const auto& testCase : testCases)
+        {
+            CheckPrinted(testCase, compiler, directory);
+            for(auto instructionSet : instructionSets)
+            {
+                if(testCase.isCompiled)
+                {
+                    CheckCompiled(testCase, instructionSet);
+                }
+            }
+            std::cout << testCase.name << ": passed" << std::endl;
+        }
+
+        CheckStaticNest();
+        std::cout << "static_nest: passed" << std::endl;
+        CheckStaticCachedOutput();
+        std::cout << "static_cached_output: passed" << std::endl;
+
+        for(const auto& testCase : rejectedCases)
+        {
+            CheckRejected(testCase);
+            std::cout << testCase.name << ": rejected" << std::endl;
+        }
+        return 0;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}